@@ -1,5 +1,23 @@
-
 if (CMAKE_TOOLCHAIN_FILE MATCHES "Emscripten.cmake$")
         set(EMSCRIPTEN ON)
         message(STATUS "Compiling for Emscripten")
 endif()
+
+set(RP_WASM_LINK_FLAGS "-O3 -s MODULARIZE=1 -s EXPORT_ES6=1 --bind")
+
+# SIMD128 + pthreads variant of rp_wasm. Shared memory requires a cross-origin
+# isolated page, scripts/rp_loader.mjs falls back to rp_wasm elsewhere
+function(add_rp_wasm_mt)
+        add_library(rp_lib_mt STATIC ${RP_SOURCES})
+        target_compile_options(rp_lib_mt PUBLIC -msimd128 -pthread)
+        target_link_options(rp_lib_mt PUBLIC -pthread)
+        target_precompile_headers(rp_lib_mt PRIVATE src/pch.h)
+        target_include_directories(rp_lib_mt PUBLIC ${CMAKE_CURRENT_SOURCE_DIR}/include)
+        target_link_libraries(rp_lib_mt PUBLIC 3rd_party)
+
+        add_executable(rp_wasm_mt exec/rp_wasm.cpp)
+        target_link_libraries(rp_wasm_mt PRIVATE rp_lib_mt)
+        target_precompile_headers(rp_wasm_mt REUSE_FROM rp_lib_mt)
+        set_target_properties(rp_wasm_mt PROPERTIES LINK_FLAGS
+                "${RP_WASM_LINK_FLAGS} -s PTHREAD_POOL_SIZE=navigator.hardwareConcurrency --emit-tsd rp_mt.d.ts")
+endfunction()
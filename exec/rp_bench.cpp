@@ -0,0 +1,204 @@
+#include "cloud.h"
+#include "counting_resource.h"
+#include "polygon.h"
+#include "rect.h"
+#include "trace.h"
+#include "workload.h"
+
+#include <sys/resource.h>
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <string_view>
+
+using namespace combinators;
+
+// Headless benchmark of make_cloud over fixed-seed synthetic workloads
+//
+//   rp_bench [--max-polygons N] [--groups 1,4,...] [--tolerances 0,2,...]
+//            [--engines spiral,polar,rotate,compact,frontier,int32,int16]
+//            [--trace out.json]
+//
+// --engines picks the spiral engine on the quadtree (spiral), on the polar
+// index (polar), turning polygons (rotate) or compacting the layout for up to
+// 64 rounds (compact), or the frontier engine. int32 and int16 are the spiral
+// engine in Coordinates::Int32, on the quadtree and on its 16-bit form
+// --trace writes the phases of every run in the Chrome trace format, which
+// needs a build with RP_TRACE
+
+constexpr static auto seed = 69420;
+
+struct Variant {
+  const char *name;
+  Engine engine;
+  CollisionIndex index;
+  bool rotate = false;
+  std::size_t compaction_rounds = 0;
+  Coordinates coordinates = Coordinates::Float;
+};
+
+constexpr static std::array variants{
+    Variant{"spiral", Engine::Spiral, CollisionIndex::Quadtree},
+    Variant{"polar", Engine::Spiral, CollisionIndex::Polar},
+    Variant{"rotate", Engine::Spiral, CollisionIndex::Quadtree, true},
+    Variant{"compact", Engine::Spiral, CollisionIndex::Quadtree, false, 64},
+    Variant{"frontier", Engine::Frontier, CollisionIndex::Quadtree},
+    Variant{"int32", Engine::Spiral, CollisionIndex::Quadtree, false, 0,
+            Coordinates::Int32},
+    Variant{"int16", Engine::Spiral, CollisionIndex::Quadtree16, false, 0,
+            Coordinates::Int32},
+};
+
+struct Case {
+  std::size_t n_polygons;
+  std::size_t n_groups;
+  float tolerance;
+  Variant variant;
+};
+
+struct Result {
+  double ms;
+  std::size_t probes;
+  std::size_t arena_bytes;
+  std::size_t qtree_bytes;
+  int placed;
+  float radius; // Of the circle the groups are split in
+  float extent; // Largest distance of a rect corner to the center
+};
+
+auto run(const Case &c) -> Result {
+  const auto [polys, indices, board_dims] =
+      WorkloadGen{seed}.workload(c.n_polygons, c.n_groups);
+
+  CountingResource upstream;
+  std::pmr::monotonic_buffer_resource arena{&upstream};
+
+  const auto start = std::chrono::steady_clock::now();
+  std::pmr::vector<PolygonE> bounds(&arena);
+  {
+    RP_TRACE_SCOPE("simplification");
+    bounds.reserve(polys.size());
+    for (const auto &poly : polys) {
+      bounds.push_back(PolygonE{Polygon{Bounds(poly.rects, &arena)}});
+      bounds.back().simplify(c.tolerance);
+    }
+  }
+  const Cloud cloud = make_cloud(
+      bounds, indices, board_dims,
+      {.coordinates = c.variant.coordinates,
+       .engine = c.variant.engine,
+       .index = c.variant.index,
+       .rotate = c.variant.rotate,
+       .compaction_rounds = c.variant.compaction_rounds},
+      &arena);
+  const auto end = std::chrono::steady_clock::now();
+
+  float extent = 0.F;
+  for (const auto &poly : bounds) {
+    for (const auto &r : poly.rects) {
+      for (Point p : {r.tl(), r.tr(), r.bl(), r.br()}) {
+        extent = std::max(extent, norm(p, board_dims.center()));
+      }
+    }
+  }
+
+  return {
+      .ms = std::chrono::duration<double, std::milli>(end - start).count(),
+      .probes = cloud.probes,
+      .arena_bytes = upstream.peak,
+      .qtree_bytes = cloud.qtree_memory.bytes,
+      .placed = cloud.number_placed,
+      .radius = cloud.radius,
+      .extent = extent,
+  };
+}
+
+template <typename T> auto parse_list(std::string_view arg) -> std::vector<T> {
+  std::vector<T> result;
+  while (not arg.empty()) {
+    T value{};
+    const auto [end, ec] =
+        std::from_chars(arg.data(), arg.data() + arg.size(), value);
+    if (ec != std::errc{}) {
+      break;
+    }
+    result.push_back(value);
+    arg.remove_prefix(end - arg.data());
+    if (arg.starts_with(',')) {
+      arg.remove_prefix(1);
+    }
+  }
+  return result;
+}
+
+auto parse_variants(std::string_view arg) -> std::vector<Variant> {
+  std::vector<Variant> result;
+  for (const auto name : std::views::split(arg, ',')) {
+    const std::string_view engine{name.begin(), name.end()};
+    for (const Variant &v : variants) {
+      if (engine == v.name) {
+        result.push_back(v);
+      }
+    }
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  std::size_t max_polygons = 1'000'000;
+  std::vector<std::size_t> groups = {1, 4, 16, 64};
+  std::vector<float> tolerances = {0.F, 2.F};
+  std::vector<Variant> engines = {variants.front()};
+  const char *trace_path = nullptr;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string_view flag = argv[i];
+    if (flag == "--max-polygons") {
+      max_polygons = parse_list<std::size_t>(argv[i + 1]).at(0);
+    } else if (flag == "--groups") {
+      groups = parse_list<std::size_t>(argv[i + 1]);
+    } else if (flag == "--tolerances") {
+      tolerances = parse_list<float>(argv[i + 1]);
+    } else if (flag == "--engines") {
+      engines = parse_variants(argv[i + 1]);
+    } else if (flag == "--trace") {
+      trace_path = argv[i + 1];
+    } else {
+      std::fprintf(stderr, "unknown flag %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::printf("%9s %6s %5s %8s %11s %12s %10s %10s %9s %9s %9s\n",
+              "polygons", "groups", "tol", "engine", "time_ms", "probes/s",
+              "arena_MiB", "qtree_MiB", "placed", "radius", "extent");
+  for (std::size_t n = 100; n <= max_polygons; n *= 10) {
+    for (std::size_t g : groups) {
+      if (2 * g > n) {
+        continue;
+      }
+      for (float tol : tolerances) {
+        for (const Variant &engine : engines) {
+          const Result r = run({n, g, tol, engine});
+          std::printf("%9zu %6zu %5.1f %8s %11.1f %12.0f %10.1f %10.2f %9d "
+                      "%9.1f %9.1f\n",
+                      n, g, tol, engine.name, r.ms,
+                      _float(r.probes) / (r.ms / 1000.),
+                      _float(r.arena_bytes) / (1 << 20),
+                      _float(r.qtree_bytes) / (1 << 20), r.placed, r.radius,
+                      r.extent);
+          std::fflush(stdout);
+        }
+      }
+    }
+  }
+
+  if (trace_path != nullptr && not trace::write_chrome_json(trace_path)) {
+    std::fprintf(stderr, "cannot write %s\n", trace_path);
+    return 1;
+  }
+
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  std::printf("peak RSS: %.1f MiB\n", _float(usage.ru_maxrss) / 1024);
+}
@@ -0,0 +1,189 @@
+#include "api.h"
+#include "hierarchy.h"
+#include "job_file.h"
+#include "workload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Batch placement of a job file into a result file, see job_file.h for both
+// formats. Jobs are placed in parallel, one per thread at a time, each out of
+// an arena on a pool that its thread keeps from job to job. Results are
+// written as jobs finish, with the time each one took:
+//
+//   rp_cli --jobs FILE --out FILE [--threads 0] [--engine spiral]
+//          [--coordinates float]
+//   rp_cli --jobs FILE --make-jobs N [--polygons 1000] [--groups 8]
+//
+// --threads 0 runs one thread per core. --engine is spiral, polar, quadtree16
+// or frontier, the last one given counts, and --coordinates float or int32,
+// see CloudOptions. quadtree16 needs --coordinates int32. --make-jobs writes N
+// fixed-seed synthetic jobs to the job file instead, see workload.h
+
+constexpr static auto seed = 69420;
+
+// Jobs of `n_polygons` polygons in `n_groups` groups
+auto make_jobs(const char *path, std::size_t n_jobs, std::size_t n_polygons,
+               std::size_t n_groups) -> bool {
+  std::vector<FlatWorkload> storage;
+  WorkloadGen gen{seed};
+  for (std::size_t i = 0; i < n_jobs; ++i) {
+    storage.push_back(flatten(gen.workload(n_polygons, n_groups)));
+  }
+  std::vector<PlaceJob> jobs;
+  for (const FlatWorkload &s : storage) {
+    jobs.push_back(s.job());
+  }
+  return job_file::write(path, jobs);
+}
+
+int main(int argc, char **argv) {
+  const char *jobs_path = nullptr;
+  const char *out_path = nullptr;
+  std::size_t threads = 0;
+  std::size_t make = 0;
+  std::size_t n_polygons = 1000;
+  std::size_t n_groups = 8;
+  CloudOptions opts;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string_view flag = argv[i];
+    const std::string_view value = argv[i + 1];
+    if (flag == "--jobs") {
+      jobs_path = argv[i + 1];
+    } else if (flag == "--out") {
+      out_path = argv[i + 1];
+    } else if (flag == "--threads" && parse(value, threads)) {
+    } else if (flag == "--engine" && value == "spiral") {
+      opts.engine = Engine::Spiral;
+      opts.index = CollisionIndex::Quadtree;
+    } else if (flag == "--engine" && value == "polar") {
+      opts.engine = Engine::Spiral;
+      opts.index = CollisionIndex::Polar;
+    } else if (flag == "--engine" && value == "quadtree16") {
+      opts.engine = Engine::Spiral;
+      opts.index = CollisionIndex::Quadtree16;
+    } else if (flag == "--engine" && value == "frontier") {
+      opts.engine = Engine::Frontier;
+      opts.index = CollisionIndex::Quadtree;
+    } else if (flag == "--coordinates" && value == "float") {
+      opts.coordinates = Coordinates::Float;
+    } else if (flag == "--coordinates" && value == "int32") {
+      opts.coordinates = Coordinates::Int32;
+    } else if (flag == "--make-jobs" && parse(value, make)) {
+    } else if (flag == "--polygons" && parse(value, n_polygons)) {
+    } else if (flag == "--groups" && parse(value, n_groups)) {
+    } else {
+      std::fprintf(stderr, "unknown flag %s %s\n", argv[i], argv[i + 1]);
+      return 1;
+    }
+  }
+  if (argc % 2 == 0) {
+    std::fprintf(stderr, "no value for %s\n", argv[argc - 1]);
+  }
+  if (argc % 2 == 0 || jobs_path == nullptr ||
+      (make == 0 && out_path == nullptr)) {
+    std::fprintf(stderr, "usage: rp_cli --jobs FILE --out FILE [--threads N] "
+                         "[--engine E] [--coordinates C]\n"
+                         "       rp_cli --jobs FILE --make-jobs N "
+                         "[--polygons N] [--groups N]\n");
+    return 1;
+  }
+  if (opts.index == CollisionIndex::Quadtree16 &&
+      opts.coordinates != Coordinates::Int32) {
+    std::fprintf(stderr, "--engine quadtree16 needs --coordinates int32\n");
+    return 1;
+  }
+  if (make > 0) {
+    if (n_groups == 0 || 2 * n_groups > n_polygons) {
+      std::fprintf(stderr, "need 0 < 2 * groups <= polygons\n");
+      return 1;
+    }
+    if (not make_jobs(jobs_path, make, n_polygons, n_groups)) {
+      std::fprintf(stderr, "cannot write %s\n", jobs_path);
+      return 1;
+    }
+    return 0;
+  }
+
+  job_file::Mapped jobs;
+  if (not jobs.open(jobs_path)) {
+    std::fprintf(stderr, "cannot read %s as a job file\n", jobs_path);
+    return 1;
+  }
+  job_file::ResultWriter out;
+  if (not out.open(out_path, jobs.size())) {
+    std::fprintf(stderr, "cannot write %s\n", out_path);
+    return 1;
+  }
+
+  // Jobs already run in parallel, their nested groups do not
+  opts.threads = 1;
+  threads = hierarchy::thread_count(threads, jobs.size());
+  std::vector<std::unique_ptr<std::pmr::unsynchronized_pool_resource>> pools;
+  for (std::size_t t = 0; t < threads; ++t) {
+    pools.push_back(std::make_unique<std::pmr::unsynchronized_pool_resource>());
+  }
+  std::mutex out_mutex;
+  bool out_ok = true;
+  std::size_t failed = 0;
+  std::size_t n_placed = 0;
+  std::size_t n_total = 0;
+  std::vector<double> times(jobs.size());
+
+  const auto start = std::chrono::steady_clock::now();
+  hierarchy::for_each_parallel(
+      jobs.size(), threads, [&](std::size_t i, std::size_t worker) {
+        std::pmr::monotonic_buffer_resource arena{pools[worker].get()};
+        const auto job_start = std::chrono::steady_clock::now();
+        job_file::RecordHeader record{.job = i, .number_placed = -1};
+        std::pmr::vector<Point> positions(&arena);
+        const std::optional<PlaceJob> job = jobs.job(i, &arena);
+        std::string error = job ? validate(*job, opts) : "cut short";
+        if (error.empty()) {
+          positions.resize(job->size());
+          record.number_placed = place(*job, positions, opts, &arena);
+          record.n_positions = static_cast<std::uint32_t>(positions.size());
+        }
+        record.ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - job_start)
+                        .count();
+        times[i] = record.ms;
+
+        const std::scoped_lock lock{out_mutex};
+        out_ok = out.write(record, positions) && out_ok;
+        if (not error.empty()) {
+          ++failed;
+          std::fprintf(stderr, "job %zu: %s\n", i, error.c_str());
+          return;
+        }
+        n_placed += _size_t(record.number_placed);
+        n_total += positions.size();
+      });
+  const double wall_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  if (not out.close() || not out_ok) {
+    std::fprintf(stderr, "cannot write %s\n", out_path);
+    return 1;
+  }
+
+  std::ranges::sort(times);
+  const auto percentile = [&times](double p) {
+    return times.empty() ? 0. : times[_size_t(p * _float(times.size() - 1))];
+  };
+  std::printf("%zu jobs, %zu failed, %zu of %zu polygons placed on %zu "
+              "threads\n",
+              jobs.size(), failed, n_placed, n_total, threads);
+  std::printf("wall %.1f ms, %.1f jobs/s, job p50 %.2f ms, p99 %.2f ms, "
+              "max %.2f ms\n",
+              wall_ms, _float(jobs.size()) / (wall_ms / 1000.),
+              percentile(.5), percentile(.99), percentile(1.));
+  return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,159 @@
+#include "job_file.h"
+#include "placement_server.h"
+#include "workload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+// Sends the jobs of a job file to rp_server, and writes its answers to a
+// result file as rp_cli does, see job_file.h. Up to --in-flight requests wait
+// for their answers at a time. --stats prints the stats of the server instead:
+//
+//   rp_client --socket PATH --jobs FILE --out FILE [--in-flight 16]
+//             [--flags 0]
+//   rp_client --socket PATH --stats 1
+//
+// --flags are a combination of placement_server::Flags
+
+void print(const placement_server::ServerStats &s) {
+  std::printf("%llu requests, %llu failed, %llu connections, %llu workers\n",
+              static_cast<unsigned long long>(s.requests),
+              static_cast<unsigned long long>(s.failed),
+              static_cast<unsigned long long>(s.connections),
+              static_cast<unsigned long long>(s.workers));
+  std::printf("queue depth %llu, max %llu\n",
+              static_cast<unsigned long long>(s.queue_depth),
+              static_cast<unsigned long long>(s.max_queue_depth));
+  std::printf("queued p50 %.2f ms, p99 %.2f ms; answered p50 %.2f ms, "
+              "p99 %.2f ms, max %.2f ms\n",
+              s.queue_ms_p50, s.queue_ms_p99, s.latency_ms_p50,
+              s.latency_ms_p99, s.latency_ms_max);
+}
+
+int main(int argc, char **argv) {
+  const char *socket_path = nullptr;
+  const char *jobs_path = nullptr;
+  const char *out_path = nullptr;
+  std::size_t in_flight = 16;
+  std::uint32_t flags = 0;
+  bool stats = false;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string_view flag = argv[i];
+    const std::string_view value = argv[i + 1];
+    if (flag == "--socket") {
+      socket_path = argv[i + 1];
+    } else if (flag == "--jobs") {
+      jobs_path = argv[i + 1];
+    } else if (flag == "--out") {
+      out_path = argv[i + 1];
+    } else if (flag == "--in-flight" && parse(value, in_flight)) {
+      in_flight = std::max<std::size_t>(in_flight, 1);
+    } else if (flag == "--flags" && parse(value, flags)) {
+    } else if (flag == "--stats") {
+      stats = value != "0";
+    } else {
+      std::fprintf(stderr, "unknown flag %s %s\n", argv[i], argv[i + 1]);
+      return 1;
+    }
+  }
+  if (argc % 2 == 0) {
+    std::fprintf(stderr, "no value for %s\n", argv[argc - 1]);
+  }
+  if (argc % 2 == 0 || socket_path == nullptr ||
+      (not stats && (jobs_path == nullptr || out_path == nullptr))) {
+    std::fprintf(stderr, "usage: rp_client --socket PATH --jobs FILE "
+                         "--out FILE [--in-flight N] [--flags N]\n"
+                         "       rp_client --socket PATH --stats 1\n");
+    return 1;
+  }
+
+  placement_server::Client client;
+  if (not client.connect(socket_path)) {
+    std::fprintf(stderr, "cannot connect to %s\n", socket_path);
+    return 1;
+  }
+  if (stats) {
+    const auto s = client.stats();
+    if (not s) {
+      std::fprintf(stderr, "no stats from %s\n", socket_path);
+      return 1;
+    }
+    print(*s);
+    return 0;
+  }
+
+  job_file::Mapped jobs;
+  if (not jobs.open(jobs_path)) {
+    std::fprintf(stderr, "cannot read %s as a job file\n", jobs_path);
+    return 1;
+  }
+  job_file::ResultWriter out;
+  if (not out.open(out_path, jobs.size())) {
+    std::fprintf(stderr, "cannot write %s\n", out_path);
+    return 1;
+  }
+
+  // Requests are sent as long as fewer than `in_flight` wait for an answer,
+  // and their ids are the indices of their jobs
+  using Clock = std::chrono::steady_clock;
+  std::vector<Clock::time_point> sent(jobs.size());
+  std::vector<double> roundtrips;
+  std::size_t n_sent = 0;
+  std::size_t failed = 0;
+  bool out_ok = true;
+  const auto start = Clock::now();
+  while (roundtrips.size() < jobs.size()) {
+    while (n_sent < jobs.size() && n_sent - roundtrips.size() < in_flight) {
+      std::pmr::monotonic_buffer_resource arena;
+      const std::optional<PlaceJob> job = jobs.job(n_sent, &arena);
+      if (not job) {
+        std::fprintf(stderr, "job %zu: cut short\n", n_sent);
+        return 1;
+      }
+      sent[n_sent] = Clock::now();
+      if (not client.send(*job, n_sent, flags)) {
+        std::fprintf(stderr, "cannot send to %s\n", socket_path);
+        return 1;
+      }
+      ++n_sent;
+    }
+    const std::optional<placement_server::Response> response =
+        client.receive();
+    if (not response || response->record.job >= jobs.size()) {
+      std::fprintf(stderr, "no answer from %s\n", socket_path);
+      return 1;
+    }
+    const std::size_t i = response->record.job;
+    roundtrips.push_back(
+        std::chrono::duration<double, std::milli>(Clock::now() - sent[i])
+            .count());
+    if (response->record.number_placed < 0) {
+      ++failed;
+      std::fprintf(stderr, "job %zu: %s\n", i, response->error.c_str());
+    }
+    out_ok = out.write(response->record, response->positions) && out_ok;
+  }
+  const double wall_ms =
+      std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  if (not out.close() || not out_ok) {
+    std::fprintf(stderr, "cannot write %s\n", out_path);
+    return 1;
+  }
+
+  std::ranges::sort(roundtrips);
+  const auto percentile = [&roundtrips](double p) {
+    return roundtrips.empty()
+               ? 0.
+               : roundtrips[_size_t(p * _float(roundtrips.size() - 1))];
+  };
+  std::printf("%zu jobs, %zu failed\n", jobs.size(), failed);
+  std::printf("wall %.1f ms, %.1f jobs/s, roundtrip p50 %.2f ms, "
+              "p99 %.2f ms, max %.2f ms\n",
+              wall_ms, _float(jobs.size()) / (wall_ms / 1000.),
+              percentile(.5), percentile(.99), percentile(1.));
+  return failed == 0 ? 0 : 2;
+}
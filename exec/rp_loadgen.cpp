@@ -0,0 +1,157 @@
+#include "placement_server.h"
+#include "workload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Load for rp_server: --connections clients, each on a thread of its own,
+// send --requests requests between them, keeping up to --in-flight of them
+// waiting for their answers at a time. The requests cycle through --jobs
+// fixed-seed synthetic jobs, see workload.h. Prints the throughput, the
+// roundtrip times, and the stats of the server once done:
+//
+//   rp_loadgen --socket PATH [--connections 4] [--requests 1000]
+//              [--in-flight 4] [--jobs 16] [--polygons 500] [--groups 8]
+//              [--flags 0]
+
+constexpr static auto seed = 69420;
+
+int main(int argc, char **argv) {
+  const char *socket_path = nullptr;
+  std::size_t n_connections = 4;
+  std::size_t n_requests = 1000;
+  std::size_t in_flight = 4;
+  std::size_t n_jobs = 16;
+  std::size_t n_polygons = 500;
+  std::size_t n_groups = 8;
+  std::uint32_t flags = 0;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string_view flag = argv[i];
+    const std::string_view value = argv[i + 1];
+    if (flag == "--socket") {
+      socket_path = argv[i + 1];
+    } else if (flag == "--connections" && parse(value, n_connections)) {
+      n_connections = std::max<std::size_t>(n_connections, 1);
+    } else if (flag == "--requests" && parse(value, n_requests)) {
+    } else if (flag == "--in-flight" && parse(value, in_flight)) {
+      in_flight = std::max<std::size_t>(in_flight, 1);
+    } else if (flag == "--jobs" && parse(value, n_jobs)) {
+      n_jobs = std::max<std::size_t>(n_jobs, 1);
+    } else if (flag == "--polygons" && parse(value, n_polygons)) {
+    } else if (flag == "--groups" && parse(value, n_groups)) {
+    } else if (flag == "--flags" && parse(value, flags)) {
+    } else {
+      std::fprintf(stderr, "unknown flag %s %s\n", argv[i], argv[i + 1]);
+      return 1;
+    }
+  }
+  if (argc % 2 == 0) {
+    std::fprintf(stderr, "no value for %s\n", argv[argc - 1]);
+  }
+  if (argc % 2 == 0 || socket_path == nullptr) {
+    std::fprintf(stderr, "usage: rp_loadgen --socket PATH [--connections N] "
+                         "[--requests N] [--in-flight N] [--jobs N] "
+                         "[--polygons N] [--groups N] [--flags N]\n");
+    return 1;
+  }
+  if (n_groups == 0 || 2 * n_groups > n_polygons) {
+    std::fprintf(stderr, "need 0 < 2 * groups <= polygons\n");
+    return 1;
+  }
+
+  std::vector<FlatWorkload> storage;
+  WorkloadGen gen{seed};
+  for (std::size_t i = 0; i < n_jobs; ++i) {
+    storage.push_back(flatten(gen.workload(n_polygons, n_groups)));
+  }
+  std::vector<PlaceJob> jobs;
+  for (const FlatWorkload &s : storage) {
+    jobs.push_back(s.job());
+  }
+
+  // Request r goes on connection r % n_connections, with id r
+  using Clock = std::chrono::steady_clock;
+  std::vector<Clock::time_point> sent(n_requests);
+  std::vector<std::vector<double>> roundtrips(n_connections);
+  std::atomic<std::size_t> failed = 0;
+  std::atomic<bool> broken = false;
+  const auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (std::size_t c = 0; c < n_connections; ++c) {
+    threads.emplace_back([&, c] {
+      placement_server::Client client;
+      if (not client.connect(socket_path)) {
+        broken = true;
+        return;
+      }
+      std::vector<double> &times = roundtrips[c];
+      std::size_t next = c;
+      std::size_t n_waiting = 0;
+      while (next < n_requests || n_waiting > 0) {
+        while (next < n_requests && n_waiting < in_flight) {
+          sent[next] = Clock::now();
+          if (not client.send(jobs[next % n_jobs], next, flags)) {
+            broken = true;
+            return;
+          }
+          next += n_connections;
+          ++n_waiting;
+        }
+        const auto response = client.receive();
+        if (not response || response->record.job >= n_requests) {
+          broken = true;
+          return;
+        }
+        --n_waiting;
+        times.push_back(std::chrono::duration<double, std::milli>(
+                            Clock::now() - sent[response->record.job])
+                            .count());
+        failed += response->record.number_placed < 0 ? 1 : 0;
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  const double wall_ms =
+      std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  if (broken) {
+    std::fprintf(stderr, "lost the connection to %s\n", socket_path);
+    return 1;
+  }
+
+  std::vector<double> times;
+  for (const std::vector<double> &t : roundtrips) {
+    times.insert(times.end(), t.begin(), t.end());
+  }
+  std::ranges::sort(times);
+  const auto percentile = [&times](double p) {
+    return times.empty() ? 0. : times[_size_t(p * _float(times.size() - 1))];
+  };
+  std::printf("%zu requests of %zu polygons on %zu connections, %zu failed\n",
+              n_requests, n_polygons, n_connections, failed.load());
+  std::printf("wall %.1f ms, %.1f requests/s, roundtrip p50 %.2f ms, "
+              "p99 %.2f ms, max %.2f ms\n",
+              wall_ms, _float(n_requests) / (wall_ms / 1000.), percentile(.5),
+              percentile(.99), percentile(1.));
+
+  placement_server::Client client;
+  std::optional<placement_server::ServerStats> s;
+  if (client.connect(socket_path)) {
+    s = client.stats();
+  }
+  if (s) {
+    std::printf("server: %llu workers, max queue depth %llu, queued p50 "
+                "%.2f ms, p99 %.2f ms; answered p50 %.2f ms, p99 %.2f ms\n",
+                static_cast<unsigned long long>(s->workers),
+                static_cast<unsigned long long>(s->max_queue_depth),
+                s->queue_ms_p50, s->queue_ms_p99, s->latency_ms_p50,
+                s->latency_ms_p99);
+  }
+  return failed == 0 ? 0 : 2;
+}
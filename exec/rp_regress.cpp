@@ -0,0 +1,269 @@
+#include "api.h"
+#include "rect.h"
+#include "workload.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// Performance and packing quality regression suite. Runs fixed-seed scenarios
+// through the engine behind `place` and compares them to a stored baseline:
+//
+// - placed count, radius, overlap count, probes and a hash of the layout must
+//   match exactly, so any change to the qtree or spiral code that moves a
+//   single polygon is flagged
+// - placed polygons must never overlap, whether or not all of them are placed
+// - the median time must stay within a tolerance band of the baseline time
+//
+//   rp_regress --baseline FILE [--update] [--time-tolerance 1.0] [--no-timing]
+//
+// --update rewrites FILE from the current tree. Do it, and commit the file,
+// when a layout change is intended or the reference machine changes
+
+constexpr static auto seed = 69420;
+constexpr static auto repetitions = 3;
+
+struct Scenario {
+  std::size_t n_polygons;
+  std::size_t n_groups;
+  float tolerance;
+  Coordinates coordinates = Coordinates::Float;
+};
+
+constexpr static std::array scenarios{
+    Scenario{500, 1, 0.F},   Scenario{500, 8, 0.F},  Scenario{500, 8, 2.F},
+    Scenario{2000, 1, 0.F},  Scenario{2000, 8, 0.F}, Scenario{2000, 8, 2.F},
+    Scenario{2000, 64, 0.F},
+    Scenario{2000, 8, 0.F, Coordinates::Int32},
+};
+
+struct Metrics {
+  int placed = 0;
+  float radius = 0.F;
+  std::size_t overlaps = 0; // Pairs of rects of placed polygons, see below
+  std::size_t probes = 0;
+  std::uint64_t layout = 0; // FNV-1a of the bits of every position
+  double ms = 0.;           // Median over the repetitions
+};
+
+auto layout_hash(std::span<const Point> positions) -> std::uint64_t {
+  std::uint64_t hash = 0xcbf29ce484222325;
+  for (const Point p : positions) {
+    for (const float f : {p.x, p.y}) {
+      hash = (hash ^ std::bit_cast<std::uint32_t>(f)) * 0x100000001b3;
+    }
+  }
+  return hash;
+}
+
+// Sweeps the input rects of the placed polygons, moved by their polygon's
+// position, along x. Unplaced polygons keep their input positions and are left
+// out. Rects only count as overlapping when they do by more than `slack` on
+// both axes, since simplification may move edges inwards by up to its
+// tolerance and moving polygons rounds their coordinates
+auto count_overlaps(std::span<const Polygon> polys,
+                    std::span<const Point> positions,
+                    const std::vector<bool> &placed, float slack)
+    -> std::size_t {
+  struct Entry {
+    Rect rect;
+    std::size_t poly;
+  };
+  std::vector<Entry> entries;
+  for (std::size_t i = 0; i < polys.size(); ++i) {
+    if (not placed[i]) {
+      continue;
+    }
+    for (Rect r : polys[i].rects) {
+      r.lft += positions[i].x;
+      r.rgt += positions[i].x;
+      r.top += positions[i].y;
+      r.bot += positions[i].y;
+      entries.push_back({r, i});
+    }
+  }
+  std::ranges::sort(entries, _lt_, [](const Entry &e) { return e.rect.lft; });
+
+  std::size_t result = 0;
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    for (std::size_t j = i + 1;
+         j < entries.size() && entries[j].rect.lft < entries[i].rect.rgt; ++j) {
+      const Rect &a = entries[i].rect;
+      const Rect &b = entries[j].rect;
+      result += entries[i].poly != entries[j].poly &&
+                std::min(a.rgt, b.rgt) - std::max(a.lft, b.lft) > slack &&
+                std::min(a.bot, b.bot) - std::max(a.top, b.top) > slack;
+    }
+  }
+  return result;
+}
+
+auto run(const Scenario &s) -> Metrics {
+  const auto [polys, indices, board_dims] =
+      WorkloadGen{seed}.workload(s.n_polygons, s.n_groups);
+  const std::vector<float> tolerances(polys.size(), s.tolerance);
+  std::vector<Point> positions(polys.size());
+
+  Metrics result;
+  std::vector<bool> placed;
+  std::array<double, repetitions> times{};
+  for (double &ms : times) {
+    std::pmr::monotonic_buffer_resource arena;
+    const auto start = std::chrono::steady_clock::now();
+    const Cloud cloud = place_polygons(
+        polys.size(),
+        [&polys](std::size_t i) { return std::span{polys[i].rects}; },
+        indices, tolerances, board_dims, positions,
+        {.coordinates = s.coordinates}, &arena);
+    const auto end = std::chrono::steady_clock::now();
+    ms = std::chrono::duration<double, std::milli>(end - start).count();
+    result.placed = cloud.number_placed;
+    result.radius = cloud.radius;
+    result.probes = cloud.probes;
+    placed.assign(cloud.placed.begin(), cloud.placed.end());
+  }
+  std::ranges::sort(times);
+  result.ms = times[repetitions / 2];
+  result.layout = layout_hash(positions);
+  result.overlaps =
+      count_overlaps(polys, positions, placed, s.tolerance + 1e-2F);
+  return result;
+}
+
+auto scenario_name(const Scenario &s) -> std::string {
+  return std::to_string(s.n_polygons) + "/" + std::to_string(s.n_groups) +
+         "/" + std::to_string(_int(s.tolerance)) +
+         (s.coordinates == Coordinates::Int32 ? "/i32" : "");
+}
+
+// One line per scenario: name placed radius overlaps probes layout ms
+auto read_baseline(const char *path) -> std::vector<Metrics> {
+  std::vector<Metrics> result;
+  std::FILE *in = std::fopen(path, "r");
+  if (in == nullptr) {
+    return result;
+  }
+  char line[256];
+  while (std::fgets(line, sizeof line, in) != nullptr) {
+    if (line[0] == '#') {
+      continue;
+    }
+    Metrics m;
+    if (std::sscanf(line, "%*s %d %a %zu %zu %" SCNx64 " %lf", &m.placed,
+                    &m.radius, &m.overlaps, &m.probes, &m.layout,
+                    &m.ms) == 6) {
+      result.push_back(m);
+    }
+  }
+  std::fclose(in);
+  return result;
+}
+
+auto write_baseline(const char *path, std::span<const Metrics> metrics)
+    -> bool {
+  std::FILE *out = std::fopen(path, "w");
+  if (out == nullptr) {
+    return false;
+  }
+  std::fputs("# polygons/groups/tolerance[/i32] placed radius overlaps probes "
+             "layout time_ms\n",
+             out);
+  for (std::size_t i = 0; i < scenarios.size(); ++i) {
+    const Metrics &m = metrics[i];
+    std::fprintf(out, "%s %d %a %zu %zu %016" PRIx64 " %.1f\n",
+                 scenario_name(scenarios[i]).c_str(), m.placed, m.radius,
+                 m.overlaps, m.probes, m.layout, m.ms);
+  }
+  return std::fclose(out) == 0;
+}
+
+int main(int argc, char **argv) {
+  const char *baseline_path = nullptr;
+  bool update = false;
+  bool timing = true;
+  double time_tolerance = 1.; // Relative, 1 fails at twice the baseline time
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view flag = argv[i];
+    if (flag == "--baseline" && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (flag == "--update") {
+      update = true;
+    } else if (flag == "--no-timing") {
+      timing = false;
+    } else if (flag == "--time-tolerance" && i + 1 < argc) {
+      time_tolerance = std::strtod(argv[++i], nullptr);
+    } else {
+      std::fprintf(stderr, "unknown flag %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (baseline_path == nullptr) {
+    std::fprintf(stderr, "missing --baseline\n");
+    return 1;
+  }
+
+  std::vector<Metrics> metrics;
+  for (const Scenario &s : scenarios) {
+    metrics.push_back(run(s));
+  }
+  if (update) {
+    if (not write_baseline(baseline_path, metrics)) {
+      std::fprintf(stderr, "cannot write %s\n", baseline_path);
+      return 1;
+    }
+    std::printf("updated %s\n", baseline_path);
+    return 0;
+  }
+
+  const std::vector<Metrics> baseline = read_baseline(baseline_path);
+  if (baseline.size() != scenarios.size()) {
+    std::fprintf(stderr, "%s: expected %zu scenarios, run with --update\n",
+                 baseline_path, scenarios.size());
+    return 1;
+  }
+
+  int failures = 0;
+  auto fail = [&failures](const std::string &name, const char *what) {
+    std::printf("FAIL %s: %s\n", name.c_str(), what);
+    ++failures;
+  };
+  for (std::size_t i = 0; i < scenarios.size(); ++i) {
+    const Metrics &m = metrics[i];
+    const Metrics &b = baseline[i];
+    const std::string name = scenario_name(scenarios[i]);
+    std::printf("%-12s placed %5d  radius %8.2f  overlaps %zu  probes %9zu  "
+                "%9.1f ms (baseline %.1f ms)\n",
+                name.c_str(), m.placed, m.radius, m.overlaps, m.probes, m.ms,
+                b.ms);
+    if (m.placed != b.placed) {
+      fail(name, "number placed changed");
+    }
+    if (m.radius != b.radius) {
+      fail(name, "radius changed");
+    }
+    if (m.overlaps != b.overlaps) {
+      fail(name, "overlap count changed");
+    }
+    if (m.overlaps != 0) {
+      fail(name, "placed polygons overlap");
+    }
+    if (m.probes != b.probes || m.layout != b.layout) {
+      fail(name, "layout changed");
+    }
+    if (timing && m.ms > b.ms * (1. + time_tolerance)) {
+      fail(name, "slower than the tolerance band");
+    }
+  }
+  if (failures > 0) {
+    std::printf("%d failures. If the changes are intended, run with --update "
+                "and commit %s\n",
+                failures, baseline_path);
+  }
+  return failures > 0 ? 1 : 0;
+}
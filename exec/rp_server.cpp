@@ -0,0 +1,88 @@
+#include "placement_server.h"
+#include "workload.h"
+
+#include <csignal>
+#include <cstdio>
+#include <string_view>
+#include <thread>
+
+#include <pthread.h>
+#include <unistd.h>
+
+// Placement daemon on a Unix domain socket, see placement_server.h for the
+// protocol. rp_client sends it job files, rp_loadgen measures it:
+//
+//   rp_server --socket PATH [--threads 0] [--max-queue 1024]
+//             [--max-request-mb 64] [--max-queue-mb 256]
+//
+// --threads 0 runs one worker per core. Requests larger than --max-request-mb
+// close their connection, and the requests being read, queued or placed take
+// at most --max-queue-mb between them. SIGINT and SIGTERM stop it once the
+// requests received by then are answered, and print its stats
+
+int main(int argc, char **argv) {
+  const char *socket_path = nullptr;
+  std::size_t threads = 0;
+  std::size_t max_queue = 1024;
+  std::size_t max_request_mb = 64;
+  std::size_t max_queue_mb = 256;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string_view flag = argv[i];
+    const std::string_view value = argv[i + 1];
+    if (flag == "--socket") {
+      socket_path = argv[i + 1];
+    } else if (flag == "--threads" && parse(value, threads)) {
+    } else if (flag == "--max-queue" && parse(value, max_queue)) {
+    } else if (flag == "--max-request-mb" && parse(value, max_request_mb)) {
+    } else if (flag == "--max-queue-mb" && parse(value, max_queue_mb)) {
+    } else {
+      std::fprintf(stderr, "unknown flag %s %s\n", argv[i], argv[i + 1]);
+      return 1;
+    }
+  }
+  if (argc % 2 == 0) {
+    std::fprintf(stderr, "no value for %s\n", argv[argc - 1]);
+  }
+  if (argc % 2 == 0 || socket_path == nullptr) {
+    std::fprintf(stderr, "usage: rp_server --socket PATH [--threads N] "
+                         "[--max-queue N] [--max-request-mb N] "
+                         "[--max-queue-mb N]\n");
+    return 1;
+  }
+
+  // Blocked before any thread starts, so that only `waiter` takes them
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  placement_server::Server server{threads, max_queue, max_request_mb << 20,
+                                  max_queue_mb << 20};
+  if (not server.listen(socket_path)) {
+    std::fprintf(stderr, "cannot listen on %s\n", socket_path);
+    return 1;
+  }
+  std::thread waiter{[&] {
+    int signal = 0;
+    sigwait(&signals, &signal);
+    server.stop();
+  }};
+  std::printf("listening on %s with %llu workers\n", socket_path,
+              static_cast<unsigned long long>(server.stats().workers));
+  std::fflush(stdout);
+  server.run();
+  pthread_kill(waiter.native_handle(), SIGTERM); // In case `run` failed
+  waiter.join();
+  ::unlink(socket_path);
+
+  const placement_server::ServerStats s = server.stats();
+  std::printf("%llu requests, %llu failed, max queue depth %llu\n",
+              static_cast<unsigned long long>(s.requests),
+              static_cast<unsigned long long>(s.failed),
+              static_cast<unsigned long long>(s.max_queue_depth));
+  std::printf("queued p50 %.2f ms, p99 %.2f ms; answered p50 %.2f ms, "
+              "p99 %.2f ms, max %.2f ms\n",
+              s.queue_ms_p50, s.queue_ms_p99, s.latency_ms_p50,
+              s.latency_ms_p99, s.latency_ms_max);
+}
@@ -1,14 +1,133 @@
+#include "api.h"
+#include "blocker_cache.h"
+#include "bvh.h"
+#include "frontier.h"
+#include "group_index.h"
+#include "job_file.h"
+#include "layout_cache.h"
+#ifndef __EMSCRIPTEN__
+#include "placement_server.h"
+#endif
+#include "polar_index.h"
 #include "polygon.h"
+#include "rp_c_api.h"
+#include "session.h"
 #include "spiral.h"
+#include "trace.h"
 
 #include <boost/ut.hpp>
 #include <cmath>
+#include <filesystem>
+#include <memory_resource>
+#include <random>
 
 using namespace boost::ut;
 
+// Sizes of the polygons of make_job. Polygon `i` is `1 + i % rects_mod` rects
+// side by side, each `w + i % w_mod` wide and `h + i % h_mod` high
+struct Bars {
+  int w = 2;
+  int w_mod = 5;
+  int h = 1;
+  int h_mod = 3;
+  int rects_mod = 1;
+  float shift = 0.F; // Of every left edge
+};
+
+struct TestJob {
+  std::vector<Rect> rects;
+  std::vector<std::size_t> offsets{0};
+  std::vector<IndexPair> indices;
+  std::vector<float> tolerances;
+
+  auto polygons() const -> std::vector<Polygon> {
+    std::vector<Polygon> result;
+    for (std::size_t i = 0; i + 1 < offsets.size(); ++i) {
+      result.push_back(
+          {Bounds{rects.begin() + _int(offsets[i]),
+                  rects.begin() + _int(offsets[i + 1])}});
+    }
+    return result;
+  }
+};
+
+// `n` polygons in a row, 10 apart. Every one after the first `n_groups` is a
+// child of polygon `i % n_groups`
+auto make_job(int n, std::size_t n_groups, const Bars &bars = {}) -> TestJob {
+  TestJob result;
+  for (int i = 0; i < n; ++i) {
+    const auto lft = _float(i * 10) + bars.shift;
+    const auto w = _float(bars.w + i % bars.w_mod);
+    for (int j = 0; j <= i % bars.rects_mod; ++j) {
+      const auto x = lft + _float(j) * w;
+      result.rects.push_back(
+          Rect{x, 0, x + w, _float(bars.h + i % bars.h_mod)});
+    }
+    result.offsets.push_back(result.rects.size());
+  }
+  for (std::size_t i = n_groups; i < result.offsets.size() - 1; ++i) {
+    result.indices.push_back({i % n_groups, i});
+  }
+  result.tolerances.assign(result.offsets.size() - 1, 0.F);
+  return result;
+}
+
+// Whether no two polygons of a job overlap once moved to `positions`. With
+// `orientations`, VERTICAL polygons are first turned about the top left corner
+// of their bounding box, as `place` does
+auto no_overlaps(std::span<const Rect> rects,
+                 std::span<const std::size_t> offsets,
+                 std::span<const Point> positions,
+                 std::span<const int> orientations = {}) -> bool {
+  std::vector<Rect> moved;
+  std::vector<std::size_t> polygon_of;
+  for (std::size_t k = 0; k < positions.size(); ++k) {
+    const auto polygon = rects.subspan(offsets[k], offsets[k + 1] - offsets[k]);
+    const Rect box = bvh_union<float>(polygon);
+    const bool vertical =
+        not orientations.empty() && orientations[k] == VERTICAL;
+    for (const Rect &r : polygon) {
+      // (x, y) turns to (h - y, x) within the bounding box
+      const Rect t = vertical ? Rect{box.lft + box.bot - r.bot,
+                                     box.top + r.lft - box.lft,
+                                     box.lft + box.bot - r.top,
+                                     box.top + r.rgt - box.lft}
+                              : r;
+      const Point p = positions[k];
+      moved.push_back({t.lft + p.x, t.top + p.y, t.rgt + p.x, t.bot + p.y});
+      polygon_of.push_back(k);
+    }
+  }
+  for (std::size_t i = 0; i < moved.size(); ++i) {
+    for (std::size_t j = 0; j < i; ++j) {
+      if (polygon_of[i] != polygon_of[j] && moved[i].does_overlap(moved[j])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Whether no two placed polygons of `session` overlap, given their input
+// rects `in`
+auto no_session_overlaps(const PlacementSession &session,
+                         const std::vector<std::vector<Rect>> &in) -> bool {
+  std::vector<Rect> rects;
+  std::vector<std::size_t> offsets{0};
+  std::vector<Point> positions;
+  for (std::size_t i = 0; i < in.size(); ++i) {
+    if (session.is_placed(i)) {
+      rects.insert(rects.end(), in[i].begin(), in[i].end());
+      offsets.push_back(rects.size());
+      positions.push_back(session.position(i));
+    }
+  }
+  return no_overlaps(rects, offsets, positions);
+}
+
 int main() {
   "test_spiral"_test = [] {
-    std::vector<Point> data = {{0, 0}, {0, 1}, {1, 0}, {1, 1}};
+    std::pmr::vector<Point> data = {{0, 0}, {0, 1}, {1, 0}, {1, 1}};
     Spiral s{data};
 
     expect(eq(*std::next(s.begin(), 0), data[0]));
@@ -37,7 +156,7 @@ int main() {
   };
 
   "test_spiral_non_invalidating"_test = [] {
-    std::vector<Point> data = {{0, 0}, {0, 1}, {1, 0}, {1, 1}};
+    std::pmr::vector<Point> data = {{0, 0}, {0, 1}, {1, 0}, {1, 1}};
     Spiral s{data};
 
     expect(eq(*std::next(s.begin(), 0), data[0]));
@@ -47,6 +166,29 @@ int main() {
     expect(3_i == s.size());
   };
 
+  "test_spiral_direction"_test = [] {
+    std::pmr::vector<Point> data = {{2, 0}, {0, 3}, {-1, 0}};
+    Spiral s{data};
+    s.aim({0, 0});
+    auto near = [](Point p, Point q) {
+      return std::abs(p.x - q.x) < 1e-6F && std::abs(p.y - q.y) < 1e-6F;
+    };
+    expect(near(s.direction(s.begin() + 1), {0, -1}));
+
+    // Directions move along with erased points
+    s.erase(s.begin() + 1);
+    expect(near(s.direction(s.begin()), {-1, 0}));
+    expect(near(s.direction(s.begin() + 1), {1, 0}));
+    s.append(std::array{Point{0, -5}});
+    expect(near(s.direction(s.begin() + 2), {0, 1}));
+
+    s.aim({0, 3});
+    expect(near(s.direction(s.begin() + 2), {0, 1}));
+    s.assign(data);
+    expect(not s.target.has_value());
+    expect(3_i == s.size());
+  };
+
   "test_rect_intersection"_test = [] {
     Rect r1{0, 0, 10, 10};
     Rect r2{5, 5, 15, 15};
@@ -61,7 +203,7 @@ int main() {
     }};
     poly.simplify(/* threshold */ 1.01F);
 
-    expect(eq(poly.rects, std::vector{
+    expect(eq(poly.rects, Bounds{
                               Rect{.lft = 0, .top = 0, .rgt = 10, .bot = 5},
                               Rect{.lft = 10, .top = 0, .rgt = 15, .bot = 10},
                           }));
@@ -75,7 +217,7 @@ int main() {
     }};
     poly.simplify(/* threshold */ 1.01F);
 
-    expect(eq(poly.rects, std::vector{
+    expect(eq(poly.rects, Bounds{
                               Rect{.lft = 0, .top = 1, .rgt = 15, .bot = 6},
                           }));
   };
@@ -87,7 +229,7 @@ int main() {
         Rect{.lft = 11, .top = 1, .rgt = 15, .bot = 7},
         Rect{.lft = 16, .top = 0, .rgt = 18, .bot = 5},
     }};
-    expect(eq(poly.outside_edge_points(), std::vector{
+    expect(eq(poly.outside_edge_points(), std::pmr::vector<Point>{
                                               Point{.x = 0, .y = 0},
                                               Point{.x = 5, .y = 0},
                                               Point{.x = 5, .y = 1},
@@ -125,7 +267,8 @@ int main() {
 
     auto expected = Point{.x = 3.1547, .y = 4};
     Point closes_isect;
-    if (not expect(poly.closest_isect(M_PI / 3.F, closes_isect)))
+    const Point dir{cosf(M_PI / 3.F), sinf(M_PI / 3.F)};
+    if (not expect(poly.closest_isect(dir, closes_isect)))
       return;
 
     auto diff = closes_isect - expected;
@@ -133,4 +276,999 @@ int main() {
     expect(diff.x < 0.001F);
     expect(diff.y < 0.001F);
   };
+
+  "test_place_arena"_test = [] {
+    const TestJob fixture = make_job(16, 2, {.w = 4, .w_mod = 3, .h = 4});
+    const std::vector<Polygon> polys = fixture.polygons();
+    const std::vector<IndexPair> &indices = fixture.indices;
+    const std::vector<float> &tolerances = fixture.tolerances;
+
+    // Any allocation that bypasses the arena throws std::bad_alloc
+    std::pmr::monotonic_buffer_resource arena;
+    auto *prev =
+        std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    auto positions = place(polys, indices, tolerances, Point{200, 200}, &arena);
+    std::pmr::set_default_resource(prev);
+
+    expect(16_i == positions.size());
+    expect(positions.get_allocator().resource() == &arena);
+  };
+
+  "test_group_index"_test = [] {
+    std::vector<PolygonE> polys;
+    for (float w : {4.F, 4.F, 1.F, 3.F, 2.F}) {
+      polys.push_back(PolygonE{{{Rect{0, 0, w, 1}}}});
+    }
+    const std::vector<IndexPair> indices = {{1, 2}, {0, 4}, {1, 3}, {0, 2}};
+
+    const auto in_order = make_group_index(polys, indices, false);
+    expect(2_i == in_order.size());
+    expect(eq(in_order.offsets, std::pmr::vector<std::size_t>{0, 2, 4}));
+    expect(eq(in_order.children, std::pmr::vector<std::size_t>{4, 2, 2, 3}));
+    expect(eq(in_order.areas, std::pmr::vector<float>{7.F, 8.F}));
+
+    const auto by_area = make_group_index(polys, indices, true);
+    expect(eq(by_area.children, std::pmr::vector<std::size_t>{4, 2, 3, 2}));
+  };
+
+  "test_place_flat_job"_test = [] {
+    const TestJob fixture = make_job(
+        12, 3, {.w = 3, .w_mod = 1, .h = 3, .h_mod = 1, .rects_mod = 2});
+    const std::vector<Polygon> polys = fixture.polygons();
+    const auto &[rects, offsets, indices, tolerances] = fixture;
+    const Point board_dims{200, 200};
+
+    std::vector<Point> positions(polys.size());
+    const PlaceJob job{rects, offsets, indices, tolerances, board_dims};
+    const int placed = place(job, positions);
+    expect(12_i == placed);
+    expect(eq(positions, place(polys, indices, tolerances, board_dims)));
+  };
+
+  "test_c_api"_test = [] {
+    const RpRect rects[] = {
+        {0, 0, 4, 4}, {0, 0, 2, 2}, {0, 0, 3, 1}, {3, 0, 4, 2}};
+    const size_t offsets[] = {0, 1, 2, 4};
+    const RpIndexPair indices[] = {{0, 1}, {0, 2}};
+    RpPosition positions[3];
+
+    RpContext *ctx = rp_context_create();
+    for (int i = 0; i < 2; ++i) {
+      expect(3_i == rp_place(ctx, positions, rects, 4, offsets, 3, indices, 2,
+                             nullptr, {100, 100}));
+    }
+    rp_context_set_int_coordinates(ctx, 1);
+    expect(3_i == rp_place(ctx, positions, rects, 4, offsets, 3, indices, 2,
+                           nullptr, {100, 100}));
+    expect(eq(positions[1].x, std::round(positions[1].x)));
+    rp_context_set_frontier(ctx, 1);
+    expect(3_i == rp_place(ctx, positions, rects, 4, offsets, 3, indices, 2,
+                           nullptr, {100, 100}));
+    rp_context_set_frontier(ctx, 0);
+
+    size_t hits = 0;
+    size_t misses = 0;
+    expect(eq(rp_context_set_cache(ctx, 4, nullptr), 0));
+    for (int i = 0; i < 3; ++i) {
+      expect(3_i == rp_place(ctx, positions, rects, 4, offsets, 3, indices, 2,
+                             nullptr, {100, 100}));
+    }
+    rp_get_cache_stats(ctx, &hits, &misses);
+    expect(eq(hits, 2) and eq(misses, 1));
+    // Turned placements bypass the cache
+    int orientations[3] = {-1, -1, -1};
+    rp_context_set_rotation(ctx, 1);
+    expect(3_i == rp_place(ctx, positions, rects, 4, offsets, 3, indices, 2,
+                           nullptr, {100, 100}));
+    expect(eq(rp_get_orientations(ctx, orientations, 3), 3));
+    expect(orientations[0] == RP_HORIZONTAL || orientations[0] == RP_VERTICAL);
+    rp_get_cache_stats(ctx, &hits, &misses);
+    expect(eq(hits, 2) and eq(misses, 1));
+    rp_context_set_rotation(ctx, 0);
+
+    const RpIndexPair bad_indices[] = {{0, 3}};
+    expect(eq(rp_place(ctx, positions, rects, 4, offsets, 3, bad_indices, 1,
+                       nullptr, {100, 100}),
+              -1));
+    expect(neq(std::string_view{rp_get_error()}, std::string_view{}));
+    const RpIndexPair cyclic_indices[] = {{0, 1}, {1, 0}};
+    rp_context_set_threads(ctx, 2);
+    expect(eq(rp_place(ctx, positions, rects, 4, offsets, 3, cyclic_indices,
+                       2, nullptr, {100, 100}),
+              -1));
+    // Options are validated as well, instead of trapping in make_cloud
+    rp_context_set_growth(ctx, 1, 1.F);
+    expect(eq(rp_place(ctx, positions, rects, 4, offsets, 3, indices, 2,
+                       nullptr, {100, 100}),
+              -1));
+    expect(neq(std::string_view{rp_get_error()}, std::string_view{}));
+    rp_context_set_growth(ctx, 0, 1.F);
+    expect(3_i == rp_place(ctx, positions, rects, 4, offsets, 3, indices, 2,
+                           nullptr, {100, 100}));
+    rp_context_destroy(ctx);
+  };
+
+  "test_layout_cache"_test = [] {
+    auto [rects, offsets, indices, tolerances] =
+        make_job(12, 3, {.w_mod = 3, .h = 3, .h_mod = 1});
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{200, 200}};
+    std::vector<Point> expected(tolerances.size());
+    const int placed = place(job, expected);
+
+    const auto path = std::filesystem::temp_directory_path() /
+                      ("rp_test_layouts_" + std::to_string(::getpid()));
+    std::filesystem::remove(path);
+    {
+      LayoutCache cache{1};
+      expect(cache.open(path.c_str()));
+      std::vector<Point> positions(tolerances.size());
+      expect(eq(cache.place(job, positions), placed));
+      expect(eq(cache.place(job, positions), placed));
+      expect(eq(positions, expected));
+      expect(eq(cache.hits(), 1) and eq(cache.misses(), 1));
+
+      // Options that move polygons are part of the key
+      cache.place(job, positions, {.coordinates = Coordinates::Int32});
+      expect(eq(cache.misses(), 2));
+      cache.place(job, positions, {.bvh_min_rects = 2});
+      expect(eq(cache.hits(), 2));
+      expect(eq(cache.lru().size(), 1) and eq(cache.file().size(), 2));
+      tolerances[0] = -0.F;
+      cache.place(job, positions);
+      expect(eq(cache.hits(), 3));
+      tolerances[0] = 1.F;
+      cache.place(job, positions);
+      expect(eq(cache.misses(), 3));
+      tolerances[0] = 0.F;
+
+      // Only one cache uses a file at a time
+      LayoutCache other;
+      expect(not other.open(path.c_str()));
+    }
+    {
+      // Layouts survive, a record cut short is dropped
+      std::filesystem::resize_file(path, std::filesystem::file_size(path) - 4);
+      LayoutCache cache;
+      expect(cache.open(path.c_str()));
+      expect(eq(cache.file().size(), 2));
+      std::vector<Point> positions(tolerances.size());
+      expect(eq(cache.place(job, positions), placed));
+      expect(eq(positions, expected));
+      expect(eq(cache.hits(), 1) and eq(cache.misses(), 0));
+
+      // A hit on the hash of another job is a miss
+      const layout_cache::Key key = layout_cache::job_key(job, {});
+      layout_cache::Key other = layout_cache::job_key(job, {.max_growths = 1});
+      other.hash = key.hash;
+      expect(cache.file().find(key, positions).has_value());
+      expect(not cache.file().find(other, positions).has_value());
+      layout_cache::Lru lru{2};
+      lru.insert(key, {placed, expected});
+      expect(lru.find(key) != nullptr and lru.find(other) == nullptr);
+      lru.insert(other, {0, expected});
+      expect(lru.find(key) == nullptr and eq(lru.size(), 1));
+    }
+    std::filesystem::remove(path);
+  };
+
+  "test_stats"_test = [] {
+    const auto [rects, offsets, indices, tolerances] =
+        make_job(40, 2, {.h = 3, .h_mod = 1});
+    std::vector<Point> positions(tolerances.size());
+
+    CloudStats stats;
+    place({rects, offsets, indices, tolerances, Point{300, 300}}, positions, {},
+          std::pmr::get_default_resource(), &stats);
+#ifdef RP_STATS
+    expect(2_i == stats.groups.size());
+    expect(gt(stats.qtree.rect_intersects, 0));
+    expect(gt(stats.qtree.point_intersects, 0));
+    expect(ge(stats.qtree.nodes_visited, stats.qtree.point_intersects));
+    expect(gt(stats.closest_isect, 0));
+    expect(gt(stats.groups[0].probed, stats.groups[0].erased));
+#else
+    expect(eq(stats.qtree.rect_intersects, 0));
+    expect(stats.groups.empty());
+#endif
+  };
+
+#ifndef __EMSCRIPTEN__
+  // The wasm module only marks phases with console.time, see trace.h
+  "test_trace"_test = [] {
+    trace::clear();
+    const std::vector<Polygon> polys{
+        {Bounds{{0, 0, 4, 4}}}, {Bounds{{0, 0, 2, 2}}}, {Bounds{{0, 0, 3, 1}}}};
+    place(polys, {{0, 1}, {0, 2}}, {0, 0, 0}, {100, 100});
+    const auto events = trace::events();
+#ifdef RP_TRACE
+    auto has = [&events](std::string_view name) {
+      return std::ranges::any_of(
+          events, [name](const trace::Event &e) { return e.name == name; });
+    };
+    for (auto name : {"simplification", "area accumulation", "split",
+                      "spiral generation", "group placement",
+                      "child placement", "group", "make_cloud"}) {
+      expect(has(name));
+    }
+    expect(ge(events.back().dur_us, 0.));
+    expect(eq(std::string_view{events.back().name}, "make_cloud"));
+#else
+    expect(events.empty());
+#endif
+  };
+
+  "test_trace_ring"_test = [] {
+    trace::clear();
+    // Restored however the test ends, later tests trace at full capacity
+    struct SmallCapacity {
+      std::size_t capacity = std::exchange(trace::recorder().capacity, 4);
+      ~SmallCapacity() { trace::recorder().capacity = capacity; }
+    };
+    const SmallCapacity small_capacity;
+    for (std::size_t i = 0; i < 10; ++i) {
+      const trace::Scope scope{"ring", i};
+    }
+    const auto events = trace::events();
+    expect(eq(events.size(), 4));
+    for (std::size_t i = 0; i < events.size(); ++i) {
+      expect(eq(events[i].arg, 6 + i));
+    }
+
+    std::FILE *out = std::tmpfile();
+    trace::write_chrome_json(out);
+    expect(gt(std::ftell(out), 0));
+    std::fclose(out);
+    expect(trace::events().empty());
+  };
+#endif
+
+  "test_int_qtree"_test = [] {
+    qtree::IQtree quadtree{qtree::IQbound{IRect{0, 0, 64, 64}}};
+    for (std::int32_t i = 0; i < 20; ++i) {
+      quadtree.insert(IRect{3 * i, 2 * i, 3 * i + 2, 2 * i + 2});
+    }
+    expect(quadtree.rect_intersects(IRect{1, 1, 2, 2}));
+    expect(not quadtree.rect_intersects(IRect{2, 0, 3, 2}));
+    expect(quadtree.point_intersects(IPoint{31, 21}));
+    expect(not quadtree.point_intersects(IPoint{32, 21}));
+    expect(eq(covering<std::int32_t>(Rect{.5F, 1.F, 2.5F, 3.F}),
+              IRect{0, 1, 3, 3}));
+  };
+
+  "test_place_int_coordinates"_test = [] {
+    const auto [rects, offsets, indices, tolerances] = make_job(30, 3);
+    std::vector<Point> positions(tolerances.size());
+
+    const int placed =
+        place({rects, offsets, indices, tolerances, Point{300, 300}}, positions,
+              {.coordinates = Coordinates::Int32});
+    expect(30_i == placed);
+    for (const Point p : positions) {
+      expect(eq(p, snap<std::int32_t>(p)));
+    }
+    expect(no_overlaps(rects, offsets, positions));
+  };
+
+  "test_place_quadtree16"_test = [] {
+    const TestJob job = make_job(30, 3);
+    auto placed_with = [&job](CollisionIndex index) {
+      std::vector<PolygonE> polys;
+      for (const Polygon &p : job.polygons()) {
+        polys.push_back(PolygonE{p});
+      }
+      const Cloud cloud =
+          make_cloud(polys, job.indices, Point{300, 300},
+                     {.coordinates = Coordinates::Int32, .index = index});
+      expect(30_i == cloud.number_placed);
+      return std::pair{polys, cloud.qtree_memory.bytes};
+    };
+    const auto [polys, bytes] = placed_with(CollisionIndex::Quadtree);
+    const auto [polys16, bytes16] = placed_with(CollisionIndex::Quadtree16);
+    expect(fits_int16(polys, Point{300, 300}, {}));
+    expect(not fits_int16(polys, Point{1e6, 1e6}, {.max_growths = 100}));
+    for (std::size_t i = 0; i < polys.size(); ++i) {
+      expect(std::ranges::equal(polys[i].rects, polys16[i].rects));
+    }
+    expect(lt(bytes16, bytes));
+  };
+
+  "test_qtree_erase"_test = [] {
+    qtree::IQtree quadtree{qtree::IQbound{IRect{0, 0, 64, 64}}};
+    for (std::int32_t i = 0; i < 20; ++i) {
+      quadtree.insert(IRect{3 * i, 2 * i, 3 * i + 2, 2 * i + 2});
+    }
+    for (std::int32_t i = 0; i < 20; i += 2) {
+      quadtree.erase(IRect{3 * i, 2 * i, 3 * i + 2, 2 * i + 2});
+    }
+    for (std::int32_t i = 0; i < 20; ++i) {
+      const IRect r{3 * i, 2 * i, 3 * i + 1, 2 * i + 1};
+      expect(eq(quadtree.rect_intersects(r), i % 2 == 1));
+    }
+    for (std::int32_t i = 1; i < 20; i += 2) {
+      quadtree.erase(IRect{3 * i, 2 * i, 3 * i + 2, 2 * i + 2});
+    }
+    const qtree::MemoryStats stats = quadtree.memory_stats();
+    expect(eq(stats.entries, 0));
+    expect(eq(stats.free_slots, stats.entry_slots));
+  };
+
+  "test_qtree_reuse_overflows"_test = [] {
+    qtree::IQtree quadtree{qtree::IQbound{IRect{0, 0, 64, 64}}};
+    const IRect r{5, 5, 6, 6};
+    for (int round = 0; round < 3; ++round) {
+      for (uint32_t i = 0; i < 2 * qtree::qtree_capacity; ++i) {
+        quadtree.insert(r);
+      }
+      for (uint32_t i = 0; i < 2 * qtree::qtree_capacity; ++i) {
+        quadtree.erase(r);
+      }
+    }
+    expect(eq(quadtree.overflows.size(), 1));
+    expect(eq(quadtree.free_overflows.size(), 1));
+    const qtree::MemoryStats stats = quadtree.memory_stats();
+    expect(eq(stats.entries, 0));
+    expect(eq(stats.free_slots, stats.entry_slots));
+  };
+
+  "test_qtree_split_overflow"_test = [] {
+    qtree::IQtree quadtree{qtree::IQbound{IRect{0, 0, 64, 64}}};
+    for (uint32_t i = 0; i < 2 * qtree::qtree_capacity; ++i) {
+      quadtree.insert(IRect{5, 5, 6 + _int(i), 6});
+    }
+    expect(eq(quadtree.memory_stats().leaves, 1));
+    for (std::int32_t i = 0; i < 4; ++i) {
+      quadtree.insert(IRect{40 + 5 * i, 40, 42 + 5 * i, 42});
+    }
+    const qtree::MemoryStats stats = quadtree.memory_stats();
+    expect(gt(stats.leaves, 1));
+    // The overlapping rects still share a child, which spills again
+    expect(eq(quadtree.overflows.size(), 1));
+    expect(eq(stats.entries, 2 * qtree::qtree_capacity + 4));
+    expect(quadtree.rect_intersects(IRect{5, 5, 6, 6}));
+    expect(quadtree.rect_intersects(IRect{55, 40, 56, 41}));
+    expect(not quadtree.rect_intersects(IRect{30, 30, 35, 35}));
+  };
+
+  "test_qtree_compact_leaves"_test = [] {
+    qtree::IQtree quadtree{qtree::IQbound{IRect{0, 0, 1024, 1024}}};
+    qtree::IQtree16 quantized{qtree::IQbound{IRect{0, 0, 1024, 1024}}};
+    std::mt19937 rng{69420};
+    std::uniform_int_distribution<std::int32_t> coord{0, 1000};
+    for (int i = 0; i < 500; ++i) {
+      const std::int32_t x = coord(rng);
+      const std::int32_t y = coord(rng);
+      quadtree.insert(IRect{x, y, x + 7, y + 5});
+      quantized.insert(IRect{x, y, x + 7, y + 5});
+    }
+    for (int i = 0; i < 500; ++i) {
+      const IPoint p{coord(rng), coord(rng)};
+      expect(eq(quadtree.point_intersects(p), quantized.point_intersects(p)));
+      const IRect r{p.x, p.y, p.x + 3, p.y + 3};
+      expect(eq(quadtree.rect_intersects(r), quantized.rect_intersects(r)));
+    }
+
+    const qtree::MemoryStats stats = quadtree.memory_stats();
+    const qtree::MemoryStats quantized_stats = quantized.memory_stats();
+    expect(ge(stats.entries, 500));
+    expect(eq(stats.entries, quantized_stats.entries));
+    expect(eq(stats.leaves, 1 + 3 * quadtree.children.size()));
+    // Slots of split leaves are reused, so few stay free
+    expect(ge(stats.entry_slots, stats.entries + stats.free_slots));
+    expect(lt(stats.free_slots, stats.entries / 2));
+    expect(lt(stats.entry_slots, stats.leaves * qtree::qtree_capacity));
+    expect(lt(quantized_stats.bytes, stats.bytes));
+  };
+
+  "test_bvh"_test = [] {
+    std::mt19937 rng{69420};
+    std::uniform_real_distribution<float> coord{0.F, 100.F};
+    std::vector<Rect> rects;
+    for (int i = 0; i < 37; ++i) {
+      const float x = coord(rng);
+      const float y = coord(rng);
+      rects.push_back(Rect{x, y, x + 4, y + 3});
+    }
+    const Bvh bvh = make_bvh<float>(rects);
+    expect(eq(bvh.rects.size(), rects.size()));
+    for (int i = 0; i < 500; ++i) {
+      const Point p{coord(rng), coord(rng)};
+      expect(eq(bvh.contains(p), ranges::any_of(rects, [p](const Rect &r) {
+                  return r.is_point_inside(p);
+                })));
+      const Rect q{p.x, p.y, p.x + 2, p.y + 2};
+      expect(eq(bvh.intersects(q), ranges::any_of(rects, [&q](const Rect &r) {
+                  return r.does_overlap(q);
+                })));
+    }
+  };
+
+  "test_frontier"_test = [] {
+    std::size_t probes = 0;
+    BasicFrontier<std::int32_t> frontier{IRect{0, 0, 10, 10},
+                                         std::pmr::get_default_resource()};
+    frontier.carve(IRect{4, 4, 6, 6}, 1, 1);
+    expect(eq(frontier.free.size(), 4));
+    for (const IRect &f : frontier.free) {
+      expect(not f.does_overlap(IRect{4, 4, 6, 6}));
+    }
+    // Above the hole rather than left of it, within the top left quarter
+    const auto at = frontier.fit(IRect{0, 0, 3, 3}, Point{5, 4},
+                                 IRect{0, 0, 5, 5}, probes);
+    expect(at.has_value() and eq(*at, Point{2, 1}));
+    expect(eq(probes, 4));
+    expect(not frontier.fit(IRect{0, 0, 5, 5}, Point{5, 5}, IRect{0, 0, 10, 10},
+                            probes));
+    // Slivers that fit nothing are dropped
+    frontier.carve(IRect{0, 1, 10, 4}, 2, 2);
+    for (const IRect &f : frontier.free) {
+      expect(f.w() >= 2 and f.h() >= 2);
+    }
+  };
+
+  "test_place_frontier"_test = [] {
+    const auto [rects, offsets, indices, tolerances] =
+        make_job(40, 4, {.shift = .3F});
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{300, 300}};
+    std::vector<Point> positions(tolerances.size());
+    for (const auto coordinates : {Coordinates::Float, Coordinates::Int32}) {
+      expect(40_i == place(job, positions,
+                           {.coordinates = coordinates,
+                            .engine = Engine::Frontier}));
+      expect(no_overlaps(rects, offsets, positions));
+      if (coordinates == Coordinates::Int32) {
+        for (const Point p : positions) {
+          expect(eq(p, snap<std::int32_t>(p)));
+        }
+      }
+    }
+  };
+
+  "test_polar_index"_test = [] {
+    std::mt19937 rng{69420};
+    std::uniform_real_distribution<float> coord{0.F, 100.F};
+    polar::PolarIndex index{qtree::Qbound{Rect{0, 0, 100, 100}}};
+    std::vector<Rect> rects;
+    for (int i = 0; i < 4000; ++i) {
+      const float x = coord(rng);
+      const float y = coord(rng);
+      rects.push_back(Rect{x, y, x + 3, y + 2});
+      index.insert(rects.back());
+    }
+    // A rect around the pole, and one across the angle where sectors wrap
+    rects.push_back(Rect{45, 45, 52, 55});
+    rects.push_back(Rect{80, 49, 90, 51});
+    index.insert(rects[rects.size() - 2]);
+    index.insert(rects.back());
+    expect(gt(index.splits(), 0));
+    for (std::size_t i = 0; i < rects.size(); i += 2) {
+      index.erase(rects[i]);
+    }
+    auto live = [](std::size_t i) { return i % 2 == 1; };
+    for (int i = 0; i < 500; ++i) {
+      const Point p{coord(rng), coord(rng)};
+      const Rect q{p.x, p.y, p.x + 1, p.y + 1};
+      bool point_hit = false;
+      bool rect_hit = false;
+      for (std::size_t j = 0; j < rects.size(); ++j) {
+        point_hit = point_hit || (live(j) && rects[j].is_point_inside(p));
+        rect_hit = rect_hit || (live(j) && rects[j].does_overlap(q));
+      }
+      expect(eq(index.point_intersects(p), point_hit));
+      expect(eq(index.rect_intersects(q), rect_hit));
+    }
+    expect(index.point_intersects(Point{50, 50}));
+    expect(index.point_intersects(Point{85, 50}));
+  };
+
+  "test_place_polar"_test = [] {
+    const auto [rects, offsets, indices, tolerances] = make_job(40, 16);
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{300, 300}};
+    std::vector<Point> positions(tolerances.size());
+    expect(40_i == place(job, positions, {.index = CollisionIndex::Polar}));
+    expect(no_overlaps(rects, offsets, positions));
+  };
+
+  "test_blocker_cache"_test = [] {
+    qtree::IQtree quadtree{qtree::IQbound{IRect{0, 0, 64, 64}}};
+    for (std::int32_t i = 0; i < 20; ++i) {
+      quadtree.insert(IRect{3 * i, 2 * i, 3 * i + 2, 2 * i + 1});
+    }
+    const auto hit = quadtree.rect_collider(IRect{30, 20, 33, 21});
+    expect(hit.has_value());
+    expect(eq(hit->value.rect, IRect{30, 20, 32, 21}));
+    expect(hit->leaf.rect.does_overlap(hit->value.rect));
+    expect(not quadtree.rect_collider(IRect{0, 1, 3, 2}).has_value());
+
+    BlockerCache<int> cache;
+    auto is = [](int v) { return [v](int b) { return b == v; }; };
+    expect(not cache.find(is(1)));
+    cache.push(1);
+    expect(cache.find(is(1)));
+    cache.push(2); // Replaces 1
+    expect(not cache.find(is(1)));
+    expect(cache.find(is(2)));
+    cache.clear();
+    expect(not cache.find(is(2)));
+  };
+
+  "test_place_bvh"_test = [] {
+    // Staircases, whose bounding boxes are mostly empty
+    std::vector<Rect> rects;
+    std::vector<std::size_t> offsets{0};
+    for (int i = 0; i < 40; ++i) {
+      const int steps = 1 + i % 24;
+      for (int j = 0; j < steps; ++j) {
+        const auto x = _float(j * 3);
+        rects.push_back(Rect{x, x, x + 3, x + 3});
+      }
+      offsets.push_back(rects.size());
+    }
+    std::vector<IndexPair> indices;
+    for (std::size_t i = 4; i < offsets.size() - 1; ++i) {
+      indices.push_back({i % 4, i});
+    }
+    const std::vector<float> tolerances(offsets.size() - 1, 0.F);
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{900, 900}};
+
+    std::vector<Point> flat(tolerances.size());
+    std::vector<Point> two_level(tolerances.size());
+    const int flat_placed = place(job, flat, {.bvh_min_rects = SIZE_MAX});
+    const int placed = place(job, two_level, {.bvh_min_rects = 2});
+    expect(40_i == placed);
+    expect(eq(flat_placed, placed));
+    expect(flat == two_level);
+  };
+
+  "test_placement_session"_test = [] {
+    const auto [rects, offsets, indices, tolerances] =
+        make_job(40, 4, {.w = 3, .h = 2});
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{400, 400}};
+    std::vector<Point> expected(job.size());
+    const int placed = place(job, expected);
+
+    // Options the session can not place as `place` does are rejected
+    expect(PlacementSession::supports({.bvh_min_rects = 2}));
+    expect(not PlacementSession::supports({.max_growths = 2}));
+    expect(not PlacementSession::supports({.coordinates = Coordinates::Int32}));
+    expect(not PlacementSession::supports({.rotate = true}));
+
+    PlacementSession session{job};
+    const SessionUpdate first = session.update();
+    expect(first.full);
+    expect(eq(first.number_placed, placed));
+    for (std::size_t i = 0; i < job.size(); ++i) {
+      expect(eq(session.position(i), expected[i]));
+    }
+
+    std::vector<std::vector<Rect>> inputs;
+    for (std::size_t i = 0; i < job.size(); ++i) {
+      const auto p = job.polygon(i);
+      inputs.emplace_back(p.begin(), p.end());
+    }
+
+    // A smaller child only re-places its own group
+    inputs[9] = {Rect{0, 0, 2, 1}};
+    session.resize_polygon(9, inputs[9], 0.F);
+    SessionUpdate update = session.update();
+    expect(not update.full);
+    expect(eq(update.groups_placed, 1));
+    expect(eq(update.number_placed, placed));
+    for (std::size_t i = 0; i < job.size(); ++i) {
+      if (i % 4 != 1) { // Not in group 1
+        expect(eq(session.position(i), expected[i]));
+      }
+    }
+    expect(no_session_overlaps(session, inputs));
+
+    // A new child of an existing group
+    inputs.push_back({Rect{0, 0, 4, 2}, Rect{4, 0, 6, 1}});
+    const std::size_t added = session.add_polygon(inputs.back(), 0.F);
+    session.add_index_pair({2, added});
+    update = session.update();
+    expect(not update.full);
+    expect(eq(update.groups_placed, 1));
+    expect(session.is_placed(added));
+    expect(no_session_overlaps(session, inputs));
+
+    session.remove_index_pair({3, 7});
+    update = session.update();
+    expect(not update.full);
+    expect(not session.is_placed(7));
+
+    // Removing a group splits the circle anew
+    session.remove_polygon(0);
+    update = session.update();
+    expect(update.full);
+    expect(eq(update.groups_placed, 3));
+    expect(not session.is_placed(0));
+    expect(not session.is_placed(4));
+    expect(no_session_overlaps(session, inputs));
+    expect(eq(session.update().groups_placed, 0));
+  };
+
+  "test_session_shared_child"_test = [] {
+    TestJob fixture = make_job(24, 3, {.w = 3, .h = 2});
+    fixture.indices.push_back({1, 3}); // 3 is a child of 0 as well
+    const auto &[rects, offsets, indices, tolerances] = fixture;
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{400, 400}};
+    std::vector<std::vector<Rect>> inputs;
+    for (std::size_t i = 0; i < job.size(); ++i) {
+      const auto p = job.polygon(i);
+      inputs.emplace_back(p.begin(), p.end());
+    }
+    PlacementSession session{job};
+    session.update();
+
+    // Still a child of 1, which re-places it
+    session.remove_index_pair({0, 3});
+    const SessionUpdate update = session.update();
+    expect(not update.full);
+    expect(eq(update.groups_placed, 2));
+    expect(session.is_placed(3));
+    expect(no_session_overlaps(session, inputs));
+
+    // Children placed later keep clear of it
+    for (const std::size_t root : {0U, 1U}) {
+      for (int i = 0; i < 4; ++i) {
+        inputs.push_back({Rect{0, 0, 3, 2}});
+        session.add_index_pair({root, session.add_polygon(inputs.back(), 0)});
+      }
+    }
+    expect(not session.update().full);
+    expect(no_session_overlaps(session, inputs));
+  };
+
+  "test_session_nested"_test = [] {
+    TestJob fixture = make_job(24, 3, {.w = 3, .h = 2});
+    const TestJob flat = fixture;
+    fixture.indices.push_back({0, 1}); // Group 1 is packed into group 0
+    auto job_of = [](const TestJob &t) {
+      return PlaceJob{t.rects, t.offsets, t.indices, t.tolerances,
+                      Point{400, 400}};
+    };
+    const PlaceJob job = job_of(fixture);
+    expect(validate(job).empty());
+    std::vector<Point> expected(job.size());
+    const int placed = place(job, expected);
+    std::vector<Point> expected_flat(job.size());
+    place(job_of(flat), expected_flat);
+    expect(expected != expected_flat);
+
+    PlacementSession session{job};
+    auto places_as = [&session](int n, const std::vector<Point> &positions) {
+      const SessionUpdate update = session.update();
+      expect(update.full);
+      expect(eq(update.number_placed, n));
+      for (std::size_t i = 0; i < positions.size(); ++i) {
+        expect(eq(session.position(i), positions[i]));
+      }
+    };
+    places_as(placed, expected);
+    // Without the nesting pair, and with it again
+    session.remove_index_pair({0, 1});
+    places_as(24, expected_flat);
+    session.add_index_pair({0, 1});
+    places_as(placed, expected);
+  };
+
+  "test_place_growth"_test = [] {
+    // Bars wider than the thin slice of their group, next to a large one
+    std::vector<Rect> rects{{0, 0, 100, 100}, {0, 0, 2, 2}, {0, 0, 1, 1}};
+    std::vector<std::size_t> offsets{0, 1, 2, 3};
+    std::vector<IndexPair> indices{{0, 2}};
+    for (int i = 0; i < 5; ++i) {
+      rects.push_back({0, 0, 80, 2});
+      indices.push_back({1, offsets.size() - 1});
+      offsets.push_back(rects.size());
+    }
+    const std::vector<float> tolerances(offsets.size() - 1, 0.F);
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{1000, 1000}};
+    std::vector<Point> positions(tolerances.size());
+
+    expect(lt(place(job, positions), 8));
+    const int placed = place(job, positions, {.max_growths = 8});
+    expect(8_i == placed);
+    expect(no_overlaps(rects, offsets, positions));
+  };
+
+  "test_turned"_test = [] {
+    // An L, turned about (0, 0) to (4 - y, x)
+    const Polygon l{Bounds{{0, 0, 2, 4}, {2, 2, 6, 4}}};
+    const std::optional<PolygonE> t = turned(l);
+    if (not expect(t.has_value())) {
+      return;
+    }
+    expect(eq(t->orientation, VERTICAL));
+    expect(t->rects == Bounds{{0, 0, 2, 6}, {2, 0, 4, 2}});
+    expect(eq(t->area(), l.area()));
+
+    // A U has two pieces across its lower rows
+    expect(not turned(Polygon{Bounds{{0, 0, 1, 3}, {1, 2, 2, 3}, {2, 0, 3, 3}}})
+                   .has_value());
+  };
+
+  "test_place_rotate"_test = [] {
+    // Bars in the thin slice of a small group, next to a large one. Most of
+    // them go in upright
+    std::vector<Rect> rects{{0, 0, 100, 100}, {0, 0, 2, 2}, {0, 0, 1, 1}};
+    std::vector<std::size_t> offsets{0, 1, 2, 3};
+    std::vector<IndexPair> indices{{0, 2}};
+    for (int i = 0; i < 8; ++i) {
+      rects.push_back({0, 0, 60, 2});
+      indices.push_back({1, offsets.size() - 1});
+      offsets.push_back(rects.size());
+    }
+    const std::vector<float> tolerances(offsets.size() - 1, 0.F);
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{1000, 1000}};
+    std::vector<Point> positions(tolerances.size());
+    std::vector<int> orientations(tolerances.size());
+
+    expect(11_i == place(job, positions, {.rotate = true},
+                         std::pmr::get_default_resource(), nullptr,
+                         orientations));
+    expect(ranges::any_of(orientations, [](int o) { return o == VERTICAL; }));
+    expect(no_overlaps(rects, offsets, positions, orientations));
+  };
+
+  "test_place_compaction"_test = [] {
+    const auto [rects, offsets, indices, tolerances] =
+        make_job(60, 8, {.w_mod = 7, .h_mod = 4});
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{300, 300}};
+    std::vector<Point> positions(tolerances.size());
+    // Summed distances of the rects to the center of the board
+    auto spread = [&] {
+      float sum = 0.F;
+      for (std::size_t k = 0; k < positions.size(); ++k) {
+        const Rect moved{rects[k].lft + positions[k].x,
+                         rects[k].top + positions[k].y,
+                         rects[k].rgt + positions[k].x,
+                         rects[k].bot + positions[k].y};
+        sum += norm(moved.center(), Point{150, 150});
+      }
+      return sum;
+    };
+
+    expect(60_i == place(job, positions));
+    const float loose = spread();
+    expect(60_i == place(job, positions, {.compaction_rounds = 64}));
+    expect(lt(spread(), loose));
+    expect(no_overlaps(rects, offsets, positions));
+  };
+
+  "test_place_nested"_test = [] {
+    // 0 holds 1 and 2, 1 holds 3, and every group has 10 children of its own
+    std::vector<Rect> rects;
+    std::vector<std::size_t> offsets{0};
+    for (int i = 0; i < 44; ++i) {
+      rects.push_back(Rect{10, 10, _float(12 + i % 5), _float(11 + i % 3)});
+      offsets.push_back(rects.size());
+    }
+    std::vector<IndexPair> indices{{0, 1}, {0, 2}, {1, 3}};
+    for (std::size_t i = 4; i < 44; ++i) {
+      indices.push_back({(i - 4) / 10, i});
+    }
+    const std::vector<float> tolerances(44, 0.F);
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{400, 400}};
+    expect(validate(job).empty());
+
+    std::vector<Point> positions(44);
+    expect(44_i == place(job, positions, {.threads = 1}));
+    expect(no_overlaps(rects, offsets, positions));
+    // Sub-clouds do not depend on the threads they are placed on
+    std::vector<Point> parallel(44);
+    expect(44_i == place(job, parallel, {.threads = 4}));
+    expect(positions == parallel);
+    // Sub-clouds allocate from `mem` only, on any number of threads
+    struct NoDefaultResource {
+      std::pmr::memory_resource *heap =
+          std::pmr::set_default_resource(std::pmr::null_memory_resource());
+      ~NoDefaultResource() { std::pmr::set_default_resource(heap); }
+    };
+    for (const std::size_t threads : {1U, 4U}) {
+      std::pmr::monotonic_buffer_resource job_arena;
+      const NoDefaultResource no_default;
+      expect(44_i == place(job, parallel, {.threads = threads}, &job_arena));
+      expect(positions == parallel);
+    }
+    // Sub-clouds on whole units, on the whole units of their sub-boards
+    expect(44_i == place(job, parallel, {.coordinates = Coordinates::Int32}));
+    expect(no_overlaps(rects, offsets, parallel));
+    for (const Point p : parallel) {
+      expect(eq(p, snap<std::int32_t>(p)));
+    }
+    // Members of sub-clouds turn, compounds do not
+    std::vector<int> orientations(44);
+    expect(44_i == place(job, parallel, {.rotate = true},
+                         std::pmr::get_default_resource(), nullptr,
+                         orientations));
+    expect(no_overlaps(rects, offsets, parallel, orientations));
+
+    // Compounds are placed by the columns around their members
+    const std::vector<Rect> members{{0, 0, 2, 2}, {2, 1, 3, 5}, {5, 0, 6, 1}};
+    std::pmr::monotonic_buffer_resource arena;
+    const Bounds hull = hierarchy::column_hull(members, &arena);
+    expect(eq(hull.size(), 3U));
+    expect(hull[0] == Rect{0, 0, 2, 2});
+    expect(hull[1] == Rect{2, 1, 5, 5});
+    expect(hull[2] == Rect{5, 0, 6, 1});
+
+    const std::vector<IndexPair> cycle{{0, 1}, {1, 0}, {0, 2}};
+    expect(validate(PlaceJob{std::span{rects}.first(3),
+                             std::span{offsets}.first(4), cycle,
+                             std::span{tolerances}.first(3), Point{400, 400}})
+               .ends_with("is its own ancestor"));
+    const std::vector<IndexPair> two_parents{{0, 2}, {1, 2}, {2, 3}};
+    expect(validate(PlaceJob{std::span{rects}.first(4),
+                             std::span{offsets}.first(5), two_parents,
+                             std::span{tolerances}.first(4), Point{400, 400}})
+               .ends_with("has another parent"));
+
+    // Group 1 is a frame around the circle of its sub-cloud, and its bars are
+    // longer than the frame is wide, so they only fit once the circle has
+    // grown past the frame, to almost four times its radius. The sub-board
+    // has to hold the quadtree bounds of the grown circle, or bars out there
+    // are not tested against each other
+    const std::vector<Rect> framed{{0, 0, 10, 10},   {0, 0, 100, 1},
+                                   {0, 99, 100, 100}, {0, 1, 1, 99},
+                                   {99, 1, 100, 99},  {0, 0, 102, 1},
+                                   {0, 0, 102, 1},    {0, 0, 102, 1},
+                                   {0, 0, 102, 1}};
+    const std::vector<std::size_t> framed_offsets{0, 1, 5, 6, 7, 8, 9};
+    const std::vector<IndexPair> framed_indices{
+        {0, 1}, {1, 2}, {1, 3}, {1, 4}, {1, 5}};
+    const std::vector<float> framed_tolerances(6, 0.F);
+    const PlaceJob framed_job{framed, framed_offsets, framed_indices,
+                              framed_tolerances, Point{2000, 2000}};
+    std::vector<Point> framed_positions(6);
+    expect(lt(place(framed_job, framed_positions), 6));
+    for (const auto coordinates : {Coordinates::Float, Coordinates::Int32}) {
+      expect(6_i == place(framed_job, framed_positions,
+                          {.coordinates = coordinates, .max_growths = 6}));
+      expect(no_overlaps(framed, framed_offsets, framed_positions));
+    }
+  };
+
+  "test_job_file"_test = [] {
+    const std::vector<Rect> rects{{0, 0, 4, 2}, {4, 1, 6, 3}, {0, 0, 3, 3},
+                                  {0, 0, 2, 5}};
+    const std::vector<std::size_t> offsets{0, 2, 3, 4};
+    const std::vector<IndexPair> indices{{0, 1}, {0, 2}};
+    const std::vector<float> tolerances{0.F, 1.F, 0.F};
+    const std::array jobs{
+        PlaceJob{rects, offsets, indices, tolerances, Point{100, 80}},
+        PlaceJob{std::span{rects}.first(3), std::span{offsets}.first(3),
+                 std::span{indices}.first(1), std::span{tolerances}.first(2),
+                 Point{50, 50}},
+    };
+    const auto path = std::filesystem::temp_directory_path() /
+                      ("rp_test_jobs_" + std::to_string(::getpid()));
+    expect(job_file::write(path.c_str(), jobs));
+    {
+      job_file::Mapped mapped;
+      expect(mapped.open(path.c_str()));
+      expect(eq(mapped.size(), 2U));
+      for (std::size_t i = 0; i < jobs.size(); ++i) {
+        const std::optional<PlaceJob> job = mapped.job(i);
+        if (not expect(job.has_value() and validate(*job).empty())) {
+          return;
+        }
+        expect(std::ranges::equal(job->rects, jobs[i].rects));
+        expect(std::ranges::equal(job->offsets, jobs[i].offsets));
+        expect(eq(job->indices.size(), jobs[i].indices.size()));
+        expect(eq(job->indices.back().dst, jobs[i].indices.back().dst));
+        expect(std::ranges::equal(job->tolerances, jobs[i].tolerances));
+        expect(eq(job->board_dims, jobs[i].board_dims));
+      }
+    }
+    // Jobs cut short are rejected, those before them are not
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+    {
+      job_file::Mapped mapped;
+      expect(mapped.open(path.c_str()));
+      expect(mapped.job(0).has_value() and not mapped.job(1).has_value());
+    }
+
+    std::vector<Point> positions(3);
+    const int placed = place(jobs[0], positions);
+    {
+      job_file::ResultWriter out;
+      expect(out.open(path.c_str(), 2));
+      expect(out.write({.job = 1, .number_placed = -1}, {}));
+      expect(out.write({.job = 0,
+                        .number_placed = placed,
+                        .n_positions = 3,
+                        .ms = 1.5},
+                       positions));
+      expect(out.close());
+    }
+    const auto results = job_file::read_results(path.c_str());
+    std::filesystem::remove(path);
+    if (not expect(results.has_value() and eq(results->size(), 2U))) {
+      return;
+    }
+    expect(eq(results->at(0).record.number_placed, -1));
+    expect(eq(results->at(1).record.job, 0U));
+    expect(eq(results->at(1).record.ms, 1.5));
+    expect(results->at(1).positions == positions);
+  };
+
+#ifndef __EMSCRIPTEN__
+  "test_placement_server"_test = [] {
+    const std::vector<Rect> rects{{0, 0, 4, 2}, {4, 1, 6, 3}, {0, 0, 3, 3},
+                                  {0, 0, 2, 5}};
+    const std::vector<std::size_t> offsets{0, 2, 3, 4};
+    const std::vector<IndexPair> indices{{0, 1}, {0, 2}};
+    const std::vector<float> tolerances{0.F, 1.F, 0.F};
+    const PlaceJob job{rects, offsets, indices, tolerances, Point{100, 80}};
+    std::vector<Point> expected(3);
+    const int placed = place(job, expected);
+
+    const auto path = std::filesystem::temp_directory_path() /
+                      ("rp_test_socket_" + std::to_string(::getpid()));
+    placement_server::Server server{2, 2, 4096};
+    expect(server.listen(path.c_str()));
+    std::thread serving{[&server] { server.run(); }};
+    placement_server::Client client;
+    expect(client.connect(path.c_str()));
+
+    std::vector<Point> positions(3);
+    expect(eq(client.place(job, positions), placed));
+    expect(positions == expected);
+    // Pipelined requests are all answered, each with its own id
+    for (std::uint64_t id = 1; id <= 6; ++id) {
+      expect(client.send(job, id));
+    }
+    std::uint64_t ids = 0;
+    for (int i = 0; i < 6; ++i) {
+      const auto response = client.receive();
+      expect(response.has_value() and response->positions == expected);
+      ids |= std::uint64_t{1} << response->record.job;
+    }
+    expect(eq(ids, 0b1111110U));
+
+    const std::vector<IndexPair> cyclic{{0, 1}, {1, 0}};
+    std::string error;
+    expect(eq(client.place({rects, offsets, cyclic, tolerances, Point{9, 9}},
+                           positions, 0, &error),
+              -1));
+    expect(not error.empty());
+    // Integer coordinates have to fit int32_t
+    const std::vector<Rect> huge{{3e9F, 0, 3.1e9F, 1}, {0, 0, 3, 3},
+                                 {0, 0, 2, 5}};
+    const std::vector<std::size_t> single{0, 1, 2, 3};
+    error.clear();
+    expect(eq(client.place({huge, single, indices, tolerances, Point{9, 9}},
+                           positions, placement_server::INT_COORDINATES,
+                           &error),
+              -1));
+    expect(error.ends_with("does not fit int32 coordinates"));
+
+    // The server is stopped however the checks go
+    if (const auto stats = client.stats(); expect(stats.has_value())) {
+      expect(eq(stats->requests, 9U));
+      expect(eq(stats->failed, 2U));
+      expect(eq(stats->workers, 2U));
+      expect(eq(stats->connections, 1U));
+      expect(le(stats->max_queue_depth, 2U));
+      expect(ge(stats->latency_ms_max, stats->latency_ms_p50));
+    }
+    // Requests over `max_request` bytes close their connection
+    const std::vector<Rect> many(512, Rect{0, 0, 1, 1});
+    std::vector<std::size_t> many_offsets{0};
+    for (std::size_t i = 1; i <= many.size(); ++i) {
+      many_offsets.push_back(i);
+    }
+    const std::vector<float> many_tolerances(many.size(), 0.F);
+    std::vector<Point> many_positions(many.size());
+    expect(eq(client.place({many, many_offsets, indices, many_tolerances,
+                            Point{100, 100}},
+                           many_positions, 0, &error),
+              -1));
+    expect(eq(error, std::string{"connection failed"}));
+    client.close();
+    server.stop();
+    serving.join();
+    std::filesystem::remove(path);
+  };
+#endif
 }
@@ -1,8 +1,155 @@
 #include "api.h"
 #include "cloud.h"
+#include "rp_c_api.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
 
 #include <emscripten.h>
 #include <emscripten/bind.h>
+#include <emscripten/val.h>
+
+static_assert(sizeof(std::size_t) == sizeof(std::uint32_t),
+              "Uint32Array views assume wasm32");
+
+// Job buffers living on the WASM heap. JS fills them through typed array views
+// and reads the positions back the same way, so nothing is marshalled field by
+// field. Views are invalidated by `resize` and by growth of the heap:
+//
+//   placer.resize(n_rects, n_polygons, n_indices);
+//   placer.rects().set(rects);          // Float32Array, lft top rgt bot
+//   placer.offsets().set(offsets);      // Uint32Array, n_polygons + 1
+//   placer.indices().set(indices);      // Uint32Array, src dst
+//   placer.tolerances().set(tolerances);
+//   placer.set_int_coordinates(true);   // Optional, see rp_c_api.h
+//   placer.set_frontier(true);          // Optional, see rp_c_api.h
+//   placer.set_growth(4, 1.25);         // Optional, see rp_c_api.h
+//   placer.set_rotation(true);          // Optional, see rp_c_api.h
+//   placer.set_compaction(64, 5);       // Optional, see rp_c_api.h
+//   placer.set_threads(4);              // Optional, rp_wasm_mt only
+//   const placed = placer.place(width, height); // -1 -> get_error()
+//   const xy = placer.positions();      // Float32Array, x y
+//   const turns = placer.orientations(); // Int32Array, 0 or 2
+//   const stats = placer.stats();       // All 0, no groups, unless RP_STATS
+class FlatPlacer {
+public:
+  void resize(std::size_t n_rects, std::size_t n_polygons,
+              std::size_t n_indices) {
+    rects_.resize(n_rects);
+    offsets_.resize(n_polygons + 1);
+    indices_.resize(n_indices);
+    tolerances_.resize(n_polygons);
+    positions_.resize(n_polygons);
+    orientations_.resize(n_polygons);
+  }
+
+  auto rects() -> emscripten::val {
+    return f32_view(reinterpret_cast<float *>(rects_.data()),
+                    rects_.size() * 4);
+  }
+  auto offsets() -> emscripten::val {
+    return u32_view(offsets_.data(), offsets_.size());
+  }
+  auto indices() -> emscripten::val {
+    return u32_view(reinterpret_cast<std::size_t *>(indices_.data()),
+                    indices_.size() * 2);
+  }
+  auto tolerances() -> emscripten::val {
+    return f32_view(tolerances_.data(), tolerances_.size());
+  }
+  auto positions() -> emscripten::val {
+    return f32_view(reinterpret_cast<float *>(positions_.data()),
+                    positions_.size() * 2);
+  }
+
+  // Of the last successful `place`, see rp_get_orientations
+  auto orientations() -> emscripten::val {
+    return emscripten::val{emscripten::typed_memory_view(
+        orientations_.size(), orientations_.data())};
+  }
+
+  auto place(float board_w, float board_h) -> int {
+    const int placed =
+        rp_place(ctx_.get(), positions_.data(), rects_.data(), rects_.size(),
+                 offsets_.data(), tolerances_.size(), indices_.data(),
+                 indices_.size(), tolerances_.data(), {board_w, board_h});
+    if (placed >= 0) {
+      rp_get_orientations(ctx_.get(), orientations_.data(),
+                          orientations_.size());
+    }
+    return placed;
+  }
+
+  void set_int_coordinates(bool enabled) {
+    rp_context_set_int_coordinates(ctx_.get(), enabled ? 1 : 0);
+  }
+
+  void set_frontier(bool enabled) {
+    rp_context_set_frontier(ctx_.get(), enabled ? 1 : 0);
+  }
+
+  void set_growth(std::size_t max_growths, float factor) {
+    rp_context_set_growth(ctx_.get(), max_growths, factor);
+  }
+
+  void set_compaction(std::size_t max_rounds, double max_ms) {
+    rp_context_set_compaction(ctx_.get(), max_rounds, max_ms);
+  }
+
+  void set_rotation(bool enabled) {
+    rp_context_set_rotation(ctx_.get(), enabled ? 1 : 0);
+  }
+
+  void set_threads(std::size_t threads) {
+    rp_context_set_threads(ctx_.get(), threads);
+  }
+
+  // Hot path counters of the last successful `place`, see rp_get_stats
+  auto stats() const -> emscripten::val {
+    RpStats totals;
+    std::vector<RpGroupStats> groups(
+        rp_get_stats(ctx_.get(), &totals, nullptr, 0));
+    rp_get_stats(ctx_.get(), &totals, groups.data(), groups.size());
+
+    auto result = emscripten::val::object();
+    result.set("rect_intersects", totals.rect_intersects);
+    result.set("point_intersects", totals.point_intersects);
+    result.set("nodes_visited", totals.nodes_visited);
+    result.set("leaf_entries_tested", totals.leaf_entries_tested);
+    result.set("overflow_spills", totals.overflow_spills);
+    result.set("closest_isect", totals.closest_isect);
+    result.set("probed", totals.probed);
+    result.set("erased", totals.erased);
+    auto per_group = emscripten::val::array();
+    for (auto [probed, erased] : groups) {
+      auto group = emscripten::val::object();
+      group.set("probed", probed);
+      group.set("erased", erased);
+      per_group.call<void>("push", group);
+    }
+    result.set("groups", per_group);
+    return result;
+  }
+
+private:
+  static auto f32_view(float *data, std::size_t size) -> emscripten::val {
+    return emscripten::val{emscripten::typed_memory_view(size, data)};
+  }
+  static auto u32_view(std::size_t *data, std::size_t size) -> emscripten::val {
+    return emscripten::val{emscripten::typed_memory_view(
+        size, reinterpret_cast<std::uint32_t *>(data))};
+  }
+
+  std::unique_ptr<RpContext, decltype(&rp_context_destroy)> ctx_{
+      rp_context_create(), &rp_context_destroy};
+  std::vector<RpRect> rects_;
+  std::vector<std::size_t> offsets_{0};
+  std::vector<RpIndexPair> indices_;
+  std::vector<float> tolerances_;
+  std::vector<RpPosition> positions_;
+  std::vector<int> orientations_;
+};
 
 EMSCRIPTEN_BINDINGS(rp) {
   emscripten::value_object<Point>("Point")
@@ -22,11 +169,36 @@ EMSCRIPTEN_BINDINGS(rp) {
   emscripten::value_object<Polygon>("Polygon")
     .field("rects", &Polygon::rects);
 
-  emscripten::register_vector<Rect>("Bounds");
+  emscripten::register_vector<Rect, Bounds::allocator_type>("Bounds");
   emscripten::register_vector<float>("FloatVec");
   emscripten::register_vector<Polygon>("Polygons");
   emscripten::register_vector<IndexPair>("Indices");
   emscripten::register_vector<Point>("Points");
 
-  emscripten::function("place", &place);
+  emscripten::function(
+      "place",
+      emscripten::select_overload<std::vector<Point>(
+          const std::vector<Polygon> &, const std::vector<IndexPair> &,
+          const std::vector<float> &, Point)>(&place));
+
+  emscripten::class_<FlatPlacer>("FlatPlacer")
+    .constructor<>()
+    .function("resize", &FlatPlacer::resize)
+    .function("rects", &FlatPlacer::rects)
+    .function("offsets", &FlatPlacer::offsets)
+    .function("indices", &FlatPlacer::indices)
+    .function("tolerances", &FlatPlacer::tolerances)
+    .function("positions", &FlatPlacer::positions)
+    .function("orientations", &FlatPlacer::orientations)
+    .function("set_int_coordinates", &FlatPlacer::set_int_coordinates)
+    .function("set_frontier", &FlatPlacer::set_frontier)
+    .function("set_growth", &FlatPlacer::set_growth)
+    .function("set_rotation", &FlatPlacer::set_rotation)
+    .function("set_compaction", &FlatPlacer::set_compaction)
+    .function("set_threads", &FlatPlacer::set_threads)
+    .function("place", &FlatPlacer::place)
+    .function("stats", &FlatPlacer::stats);
+
+  emscripten::function("get_error",
+                       +[]() -> std::string { return rp_get_error(); });
 }
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "api.h"
+#include "polygon.h"
+#include "rect.h"
+
+#include <charconv>
+#include <random>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// Fixed-seed synthetic placement jobs, and the parsing of command line values,
+// shared by the tools in exec/
+
+// Whether all of `arg` is a number of type `T`, which then goes into `out`.
+// `out` is left as it was otherwise
+template <typename T> auto parse(std::string_view arg, T &out) -> bool {
+  T result{};
+  const char *end = arg.data() + arg.size();
+  const auto [at, error] = std::from_chars(arg.data(), end, result);
+  if (error != std::errc{} || at != end) {
+    return false;
+  }
+  out = result;
+  return true;
+}
+
+struct Workload {
+  std::vector<Polygon> polys; // Sorted by area, largest first
+  std::vector<IndexPair> indices;
+  Point board_dims;
+};
+
+// The flat arrays of a workload, which `job` points into
+struct FlatWorkload {
+  std::vector<Rect> rects;
+  std::vector<std::size_t> offsets{0};
+  std::vector<IndexPair> indices;
+  std::vector<float> tolerances; // All 0
+  Point board_dims;
+
+  auto job() const -> PlaceJob {
+    return {rects, offsets, indices, tolerances, board_dims};
+  }
+};
+
+inline auto flatten(const Workload &w) -> FlatWorkload {
+  FlatWorkload result;
+  for (const Polygon &p : w.polys) {
+    result.rects.insert(result.rects.end(), p.rects.begin(), p.rects.end());
+    result.offsets.push_back(result.rects.size());
+  }
+  result.indices = w.indices;
+  result.tolerances.assign(w.polys.size(), 0.F);
+  result.board_dims = w.board_dims;
+  return result;
+}
+
+class WorkloadGen {
+public:
+  explicit WorkloadGen(unsigned seed) : rng{seed} {}
+
+  // Rects of random_rectangle in rp_native.cpp, in runs of up to three with
+  // jittered edges, so that simplification has something to merge
+  auto polygon() -> Polygon {
+    const auto n_rects = value(1, 3);
+    const auto top = _float(value(0, 1400));
+    auto lft = _float(value(0, 2400));
+    Polygon result;
+    for (int i = 0; i < n_rects; ++i) {
+      const auto w = _float(value(20, 50));
+      const auto s = _float(value(20, 50)) / 100.F;
+      const auto jitter = _float(value(0, 2));
+      result.rects.push_back(Rect{
+          .lft = lft,
+          .top = top + jitter,
+          .rgt = lft + w,
+          .bot = top + jitter + std::round(w * s),
+      });
+      lft += w;
+    }
+    return result;
+  }
+
+  // As random_index_pair_gen in rp_native.cpp, except that the first children
+  // go round robin so that no group is left empty
+  auto index_pair(std::size_t n_groups, std::size_t dst) -> IndexPair {
+    const auto src = dst < 2 * n_groups
+                         ? dst - n_groups
+                         : _size_t(value(0, _int(n_groups) - 1));
+    return IndexPair{.src = src, .dst = dst};
+  }
+
+  // The board is large enough for the quadtree bounds never to be clipped
+  auto workload(std::size_t n_polygons, std::size_t n_groups) -> Workload {
+    CUSTOM_ASSERT(2 * n_groups <= n_polygons);
+    Workload result;
+    result.polys.resize(n_polygons);
+    std::ranges::generate(result.polys, [this] { return polygon(); });
+    std::ranges::sort(result.polys, _gt_, &Polygon::area);
+    for (std::size_t dst = n_groups; dst < n_polygons; ++dst) {
+      result.indices.push_back(index_pair(n_groups, dst));
+    }
+    const float total_area =
+        accumulate(result.polys, 0.F, _plus_, &Polygon::area);
+    const float side = 5.F * std::sqrt(total_area / _float(M_PI));
+    result.board_dims = {side, side};
+    return result;
+  }
+
+private:
+  auto value(int lo, int hi) -> int {
+    return std::uniform_int_distribution{lo, hi}(rng);
+  }
+
+  std::mt19937 rng;
+};
@@ -1,21 +1,256 @@
 #pragma once
 
+#include "bvh.h"
 #include "cloud.h"
+#include "hierarchy.h"
 #include "rect.h"
+#include "trace.h"
 
-inline auto place(std::vector<Polygon> skills, std::vector<IndexPair> indices,
-                  std::vector<float> tolerances,
-                  Point board_dims) -> std::vector<Point> {
-  std::vector<PolygonE> bounds;
-  bounds.reserve(skills.size());
-  for (auto [skill, tol] : zip(skills, tolerances)) {
-    bounds.emplace_back(skill);
-    bounds.back().simplify(tol);
+#include <cmath>
+#include <memory_resource>
+#include <span>
+#include <string>
+
+// Flat, caller-owned input of a single placement job. Polygon `i` is made of
+// `rects[offsets[i] .. offsets[i + 1])`
+struct PlaceJob {
+  std::span<const Rect> rects;
+  std::span<const std::size_t> offsets;
+  std::span<const IndexPair> indices;
+  std::span<const float> tolerances;
+  Point board_dims;
+
+  auto size() const -> std::size_t {
+    return offsets.empty() ? 0 : offsets.size() - 1;
+  }
+  auto polygon(std::size_t i) const -> std::span<const Rect> {
+    return rects.subspan(offsets[i], offsets[i + 1] - offsets[i]);
+  }
+};
+
+// Empty when `job` can be placed, otherwise a description of the first problem.
+// Jobs coming from outside of C++ should be validated, `place` only asserts
+inline auto validate(const PlaceJob &job) -> std::string {
+  using std::to_string;
+  const std::size_t n = job.size();
+  if (n == 0) {
+    return "no polygons";
+  }
+  if (job.offsets.front() != 0 || job.offsets.back() != job.rects.size()) {
+    return "offsets must start at 0 and end at the number of rects";
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    if (job.offsets[i] >= job.offsets[i + 1]) {
+      return "polygon " + to_string(i) + " has no rects";
+    }
+  }
+  for (std::size_t i = 0; i < job.rects.size(); ++i) {
+    const Rect &r = job.rects[i];
+    if (not(std::isfinite(r.lft) && std::isfinite(r.top) &&
+            std::isfinite(r.rgt) && std::isfinite(r.bot))) {
+      return "rect " + to_string(i) + " is not finite";
+    }
+    if (not(r.w() > 0.F && r.h() > 0.F)) {
+      return "rect " + to_string(i) + " has no area";
+    }
+  }
+  if (not(std::isfinite(job.board_dims.x) && std::isfinite(job.board_dims.y))) {
+    return "board dimensions are not finite";
+  }
+  if (job.tolerances.size() != n) {
+    return "expected " + to_string(n) + " tolerances, got " +
+           to_string(job.tolerances.size());
   }
-  auto [placed, _] = make_cloud(bounds, indices, board_dims);
-  std::vector<Point> result;
-  for (auto&& [bound, skill] : ranges::views::zip(bounds, skills)) {
-    result.push_back(bound.rects.front().tl() - skill.rects.front().tl());
+  if (job.indices.empty()) {
+    return "no index pairs";
   }
+  std::size_t max_src = 0;
+  for (auto [src, dst] : job.indices) {
+    if (src >= n || dst >= n) {
+      return "index pair {" + to_string(src) + ", " + to_string(dst) +
+             "} out of range";
+    }
+    if (src == dst) {
+      return "polygon " + to_string(src) + " is its own child";
+    }
+    max_src = std::max(max_src, src);
+  }
+  std::vector<bool> has_children(max_src + 1);
+  for (auto [src, _] : job.indices) {
+    has_children[src] = true;
+  }
+  for (std::size_t src = 0; src <= max_src; ++src) {
+    if (not has_children[src]) {
+      return "group " + to_string(src) + " has no children";
+    }
+  }
+  // Nested groups, see hierarchy.h. Inner groups and their children have a
+  // single parent, and every chain of parents ends in a root
+  constexpr std::size_t none = hierarchy::no_parent;
+  std::vector<std::size_t> parent(n, none);
+  for (auto [src, dst] : job.indices) {
+    if (parent[dst] == none) {
+      parent[dst] = src;
+    }
+  }
+  auto is_inner = [&](std::size_t i) {
+    return i <= max_src && parent[i] != none;
+  };
+  for (auto [src, dst] : job.indices) {
+    if (parent[dst] != src && (is_inner(src) || is_inner(dst))) {
+      return "polygon " + to_string(dst) + " is in a nested group and has " +
+             "another parent";
+    }
+  }
+  enum : char { UNSEEN, ON_CHAIN, ENDS_IN_ROOT };
+  std::vector<char> state(max_src + 1, UNSEEN);
+  std::vector<std::size_t> chain;
+  for (std::size_t i = 0; i <= max_src; ++i) {
+    chain.clear();
+    std::size_t up = i;
+    for (; up != none && state[up] == UNSEEN; up = parent[up]) {
+      state[up] = ON_CHAIN;
+      chain.push_back(up);
+    }
+    if (up != none && state[up] == ON_CHAIN) {
+      return "group " + to_string(up) + " is its own ancestor";
+    }
+    for (const std::size_t j : chain) {
+      state[j] = ENDS_IN_ROOT;
+    }
+  }
+  return {};
+}
+
+// Same for the options, which `make_cloud` only asserts as well
+inline auto validate(const CloudOptions &opts) -> std::string {
+  if (opts.max_growths > 0 &&
+      not(opts.growth_factor > 1.F && std::isfinite(opts.growth_factor))) {
+    return "growth factor must be finite and greater than 1, got " +
+           std::to_string(opts.growth_factor);
+  }
+  return {};
+}
+
+// Both of the above, and under Coordinates::Int32 that every rect and the
+// board fit `std::int32_t`, which `covering` and `coord_cast` convert them to
+inline auto validate(const PlaceJob &job, const CloudOptions &opts)
+    -> std::string {
+  if (auto error = validate(opts); not error.empty()) {
+    return error;
+  }
+  if (auto error = validate(job); not error.empty()) {
+    return error;
+  }
+  if (opts.coordinates != Coordinates::Int32) {
+    return {};
+  }
+  // 2^31 is a float, INT32_MAX is not
+  constexpr float bound = 2147483648.F;
+  auto fits = [](float v) { return v >= -bound && v < bound; };
+  for (std::size_t i = 0; i < job.rects.size(); ++i) {
+    const Rect &r = job.rects[i];
+    if (not(fits(r.lft) && fits(r.top) && fits(r.rgt) && fits(r.bot))) {
+      return "rect " + std::to_string(i) + " does not fit int32 coordinates";
+    }
+  }
+  if (not(fits(job.board_dims.x) && fits(job.board_dims.y))) {
+    return "board dimensions do not fit int32 coordinates";
+  }
+  return {};
+}
+
+// `polygon_rects(i)` yields the input rects of polygon `i`. They are copied
+// once into the working polygons, which `make_nested_cloud` then moves in
+// place.
+// Orientations are written to `orientations`, if given, see `place`
+template <typename PolygonRects>
+inline auto place_polygons(std::size_t n_polygons, PolygonRects polygon_rects,
+                           std::span<const IndexPair> indices,
+                           std::span<const float> tolerances, Point board_dims,
+                           std::span<Point> out, const CloudOptions &opts,
+                           std::pmr::memory_resource *mem,
+                           std::span<int> orientations = {}) -> Cloud {
+  CUSTOM_ASSERT(tolerances.size() == n_polygons);
+  CUSTOM_ASSERT(out.size() == n_polygons);
+  CUSTOM_ASSERT(orientations.empty() || orientations.size() == n_polygons);
+
+  std::pmr::vector<PolygonE> bounds(mem);
+  {
+    RP_TRACE_SCOPE("simplification");
+    bounds.reserve(n_polygons);
+    for (std::size_t i = 0; i < n_polygons; ++i) {
+      const std::span<const Rect> rects = polygon_rects(i);
+      bounds.push_back(
+          PolygonE{Polygon{Bounds(rects.begin(), rects.end(), mem)}});
+      bounds.back().simplify(tolerances[i]);
+    }
+  }
+  Cloud cloud = make_nested_cloud(bounds, indices, board_dims, opts, mem);
+  for (std::size_t i = 0; i < n_polygons; ++i) {
+    if (bounds[i].orientation == HORIZONTAL) {
+      out[i] = bounds[i].rects.front().tl() - polygon_rects(i).front().tl();
+    } else {
+      // Turned about the top left corner of its bounding box, which
+      // simplification leaves where it was
+      out[i] = bvh_union<float>(bounds[i].rects).tl() -
+               bvh_union<float>(polygon_rects(i)).tl();
+    }
+    if (not orientations.empty()) {
+      orientations[i] = bounds[i].orientation;
+    }
+  }
+  return cloud;
+}
+
+// Writes the offset of every polygon of `job` into `out` and returns the number
+// of polygons placed. Scratch buffers are allocated from `mem`. Hot path
+// counters are copied to `stats` if given, see stats.h.
+//
+// With CloudOptions::rotate, the orientation of every polygon goes into
+// `orientations`. A VERTICAL polygon is turned about the top left corner of
+// its bounding box, see `turned`, before it is moved by its offset
+inline auto place(const PlaceJob &job, std::span<Point> out,
+                  const CloudOptions &opts = {},
+                  std::pmr::memory_resource *mem =
+                      std::pmr::get_default_resource(),
+                  CloudStats *stats = nullptr,
+                  std::span<int> orientations = {}) -> int {
+  CUSTOM_ASSERT(job.offsets.empty() || job.offsets.back() == job.rects.size());
+  CUSTOM_ASSERT(not opts.rotate || orientations.size() == job.size());
+  Cloud cloud = place_polygons(
+      job.size(), [&job](std::size_t i) { return job.polygon(i); },
+      job.indices, job.tolerances, job.board_dims, out, opts, mem,
+      orientations);
+  if (stats != nullptr) {
+    *stats = std::move(cloud.stats);
+  }
+  return cloud.number_placed;
+}
+
+// Every intermediate buffer, as well as the result, is allocated from `mem`,
+// so a whole job can be run out of a single monotonic arena
+inline auto place(const std::vector<Polygon> &skills,
+                  const std::vector<IndexPair> &indices,
+                  const std::vector<float> &tolerances, Point board_dims,
+                  std::pmr::memory_resource *mem) -> std::pmr::vector<Point> {
+  std::pmr::vector<Point> result(skills.size(), mem);
+  place_polygons(
+      skills.size(),
+      [&skills](std::size_t i) { return std::span{skills[i].rects}; },
+      indices, tolerances, board_dims, result, {}, mem);
+  return result;
+}
+
+inline auto place(const std::vector<Polygon> &skills,
+                  const std::vector<IndexPair> &indices,
+                  const std::vector<float> &tolerances,
+                  Point board_dims) -> std::vector<Point> {
+  std::vector<Point> result(skills.size());
+  std::pmr::monotonic_buffer_resource arena;
+  place_polygons(
+      skills.size(),
+      [&skills](std::size_t i) { return std::span{skills[i].rects}; },
+      indices, tolerances, board_dims, result, {}, &arena);
   return result;
 }
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <optional>
+
+// The object that blocked the last probe. Consecutive spiral points are close
+// together, so whatever blocked one probe likely blocks the next as well, and
+// is tested before descending the quadtree. Only hits are trusted, a miss says
+// nothing about the rest of the tree
+template <typename Blocker> struct BlockerCache {
+  std::optional<Blocker> blocker;
+
+  // True if `blocks` accepts the cached blocker
+  template <typename Blocks> auto find(Blocks blocks) const -> bool {
+    return blocker.has_value() && blocks(*blocker);
+  }
+
+  void push(const Blocker &b) { blocker = b; }
+
+  void clear() { blocker.reset(); }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "defines.h"
+#include "rect.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+
+// Bounding volume hierarchy over the rects of a single polygon. The quadtree
+// only holds the bounding box of a detailed polygon, its rects are looked up
+// here once a query overlaps that box. Nodes are stored depth first, an inner
+// node is followed by its left child
+constexpr static std::size_t bvh_leaf_size = 4;
+
+template <typename T> struct BasicBvhNode {
+  BasicRect<T> bound;
+  uint32_t first; // First rect of a leaf, or the right child of an inner node
+  uint32_t count; // 0 for inner nodes
+};
+
+template <typename T> struct BasicBvh {
+  std::pmr::vector<BasicBvhNode<T>> nodes;
+  std::pmr::vector<BasicRect<T>> rects; // In leaf order
+
+  auto bound() const -> BasicRect<T> { return nodes.front().bound; }
+
+  auto intersects(const BasicRect<T> &r) const -> bool {
+    return any([&r](const BasicRect<T> &b) { return b.does_overlap(r); });
+  }
+  auto contains(BasicPoint<T> p) const -> bool {
+    return any([p](const BasicRect<T> &b) { return b.is_point_inside(p); });
+  }
+
+  // Bounds are strictly larger than what they bound, so `hit` is asked about
+  // them first
+  template <typename Hit> auto any(Hit hit) const -> bool {
+    std::array<uint32_t, 64> stack; // Deeper than any balanced tree of rects
+    std::size_t size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+      const uint32_t i = stack[--size];
+      const BasicBvhNode<T> &node = nodes[i];
+      if (not hit(node.bound)) {
+        continue;
+      }
+      if (node.count > 0) {
+        for (uint32_t j = node.first; j < node.first + node.count; ++j) {
+          if (hit(rects[j])) {
+            return true;
+          }
+        }
+      } else {
+        stack[size++] = node.first;
+        stack[size++] = i + 1;
+      }
+    }
+    return false;
+  }
+};
+
+using Bvh = BasicBvh<float>;
+
+template <typename T>
+inline auto bvh_union(std::span<const BasicRect<T>> rects) -> BasicRect<T> {
+  BasicRect<T> result = rects.front();
+  for (const auto &r : rects) {
+    result = {std::min(result.lft, r.lft), std::min(result.top, r.top),
+              std::max(result.rgt, r.rgt), std::max(result.bot, r.bot)};
+  }
+  return result;
+}
+
+template <typename T>
+inline void bvh_build(BasicBvh<T> &bvh, uint32_t first, uint32_t count) {
+  const std::span rects = std::span{bvh.rects}.subspan(first, count);
+  const auto node = static_cast<uint32_t>(bvh.nodes.size());
+  bvh.nodes.push_back({bvh_union<T>(rects), first, count});
+  if (count <= bvh_leaf_size) {
+    return;
+  }
+
+  // Median split along the longer side of the bounds
+  const BasicRect<T> bound = bvh.nodes[node].bound;
+  const auto half = count / 2;
+  const auto mid = rects.begin() + half;
+  if (bound.w() >= bound.h()) {
+    std::ranges::nth_element(rects, mid, _lt_,
+                             [](const auto &r) { return r.lft + r.rgt; });
+  } else {
+    std::ranges::nth_element(rects, mid, _lt_,
+                             [](const auto &r) { return r.top + r.bot; });
+  }
+  bvh.nodes[node].count = 0;
+  bvh_build(bvh, first, half);
+  bvh.nodes[node].first = static_cast<uint32_t>(bvh.nodes.size());
+  bvh_build(bvh, first + half, count - half);
+}
+
+template <typename T>
+inline auto make_bvh(std::span<const BasicRect<T>> rects,
+                     std::pmr::memory_resource *mem =
+                         std::pmr::get_default_resource()) -> BasicBvh<T> {
+  CUSTOM_ASSERT(not rects.empty());
+  BasicBvh<T> result{
+      .nodes = std::pmr::vector<BasicBvhNode<T>>(mem),
+      .rects = std::pmr::vector<BasicRect<T>>(rects.begin(), rects.end(), mem),
+  };
+  result.nodes.reserve(rects.size()); // Leaves hold at least 2 rects
+  bvh_build(result, 0, static_cast<uint32_t>(rects.size()));
+  return result;
+}
@@ -10,7 +10,10 @@ struct Circ {
   Point center;
   float radius;
 
-  auto split(std::span<const float> weights) const -> std::vector<Slice>;
+  auto split(std::span<const float> weights,
+             std::pmr::memory_resource *mem =
+                 std::pmr::get_default_resource()) const
+      -> std::pmr::vector<Slice>;
 };
 
 template <std::size_t Res> struct SlicePoints {
@@ -32,11 +35,12 @@ struct IndexPair {
   std::size_t dst;
 };
 
-inline auto
-Circ::split(std::span<const float> weights) const -> std::vector<Slice> {
+inline auto Circ::split(std::span<const float> weights,
+                        std::pmr::memory_resource *mem) const
+    -> std::pmr::vector<Slice> {
   CUSTOM_ASSERT(weights.size() >= 1);
 
-  std::vector<Slice> result;
+  std::pmr::vector<Slice> result(mem);
   result.reserve(weights.size());
   const auto total_weight = accumulate(weights, 0.F);
   float theta = 0.F;
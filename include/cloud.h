@@ -1,12 +1,23 @@
 #pragma once
 
+#include "blocker_cache.h"
+#include "bvh.h"
 #include "circ.h"
 #include "defines.h"
+#include "frontier.h"
+#include "group_index.h"
+#include "polar_index.h"
 #include "polygon.h"
 #include "qtree.h"
 #include "range/v3/algorithm/any_of.hpp"
 #include "rect.h"
 #include "spiral.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <chrono>
+#include <limits>
+#include <optional>
 
 inline auto slice_points(Slice slice) -> std::vector<Point> {
   constexpr float rad_inc = (M_PI * 2) / 100;
@@ -35,9 +46,10 @@ inline auto bounds_points(const Bounds &b) -> std::vector<Point> {
   return result;
 }
 
+template <typename T = float>
 inline void make_center_eq(const Point v, Polygon &b) {
   auto c = centroid(b.outside_edge_points());
-  auto d = v - c;
+  auto d = snap<T>(v - c);
   for (auto &r : b.rects) {
     r.lft += d.x;
     r.rgt += d.x;
@@ -46,94 +58,718 @@ inline void make_center_eq(const Point v, Polygon &b) {
   }
 }
 
-inline auto
-make_cloud(std::span<PolygonE> polys, std::span<const IndexPair> indices,
-           Point board_dims) -> std::pair<int, std::vector<Spiral>> {
-  CUSTOM_ASSERT(!polys.empty());
-  CUSTOM_ASSERT(!indices.empty());
-
-  const size_t max_src_inx = max_element(indices, _lt_, &IndexPair::src)->src;
-  std::vector<float> areas(max_src_inx + 1);
-  for (auto [src, dst] : indices) {
-    CUSTOM_ASSERT(src < polys.size());
-    CUSTOM_ASSERT(dst < polys.size());
-    CUSTOM_ASSERT(src != dst);
-    if (areas[src] == 0.F)
-      areas[src] = accumulate(polys[src].rects, 0.F, _plus_, &Rect::area);
-    areas[src] += accumulate(polys[dst].rects, 0.F, _plus_, &Rect::area);
-  }
-  CUSTOM_ASSERT(all_of(areas, _gt(0.F)));
-  const float total_area = accumulate(areas, 0.F);
-  const float radius = std::sqrt(total_area / M_PI);
-  const Point center = board_dims.center();
-  const Circ circ{center, radius};
+enum class Coordinates {
+  Float,
+  // Polygons only move by whole units and the quadtree stores int32 rects, so
+  // overlap tests are exact integer compares. Inputs on a pixel grid, or on a
+  // fixed point grid scaled to integers, stay on it
+  Int32,
+};
 
-  const auto slices = circ.split(areas);
-  auto spirals = slices | transform(spiral) | to_vector;
-  const auto spirals_cp = spirals;
-  CUSTOM_ASSERT(spirals.size() == areas.size());
+enum class Engine {
+  // Polygons are moved along a spiral in the slice of their group until they
+  // fit, probing the quadtree at every point
+  Spiral,
+  // Polygons go by their bounding box into the free rect of their slice that
+  // is closest to its centroid, see frontier.h. Nothing is probed, but each
+  // polygon takes up its whole bounding box
+  Frontier,
+};
+
+enum class CollisionIndex {
+  Quadtree,
+  // Cells of sectors within rings around the center, see polar_index.h. The
+  // probes of a group only visit the cells of its slice. Points on the lines
+  // that divide quadtree leaves can place differently
+  Polar,
+  // The quadtree with 16-bit leaf entries, qtree::IQtree16, under
+  // Coordinates::Int32 and where every rect fits them, see fits_int16. The
+  // quadtree otherwise. Places as the quadtree does
+  Quadtree16,
+};
+
+struct CloudOptions {
+  // Within a group, place larger children first
+  bool sort_children_by_area = false;
+  Coordinates coordinates = Coordinates::Float;
+  Engine engine = Engine::Spiral;
+  CollisionIndex index = CollisionIndex::Quadtree; // Spiral engine only
+  // Placed polygons of at least this many rects go into the quadtree as their
+  // bounding box, and their rects into a BVH of their own that is only
+  // searched when a query hits that box
+  std::size_t bvh_min_rects = 16;
+  // While polygons are left over, grow the circle by `growth_factor`, at most
+  // `max_growths` times. What is placed stays, and only the spirals of groups
+  // with polygons left are extended outwards. Spiral engine only
+  std::size_t max_growths = 0;
+  float growth_factor = 1.25F;
+  // Try every polygon turned by 90 degrees as well, see `turned` and
+  // BasicPlacer::place_child. Placed polygons keep the orientation they fitted
+  // in, in PolygonE::orientation. Spiral engine only
+  bool rotate = false;
+  // After placing, pull the placed polygons toward the centroid of the slice
+  // of their group, one step per round, see `compact`. For at most
+  // `compaction_rounds` rounds, and `compaction_ms` milliseconds unless that
+  // is 0, which makes layouts depend on the speed of the machine. Spiral
+  // engine only
+  std::size_t compaction_rounds = 0;
+  double compaction_ms = 0;
+  // Sub-clouds of nested groups are placed on up to this many threads, see
+  // hierarchy.h. 0 for one per core. Does not change layouts
+  std::size_t threads = 0;
+};
 
+struct Cloud {
+  int number_placed = 0;
+  std::pmr::vector<bool> placed; // Of every polygon
+  std::pmr::vector<Spiral> spirals;
+  float radius = 0.F;                // Including growth
+  std::size_t growths = 0;           // See CloudOptions::max_growths
+  std::size_t compaction_rounds = 0; // Run, see CloudOptions
+  std::size_t probes = 0;            // Spiral points or free rects tried
+  CloudStats stats;                  // Only filled in under RP_STATS
+  qtree::MemoryStats qtree_memory;
+};
+
+// Quadtree around the circle of `radius`, with as much padding again on each
+// side, clipped to the board
+inline auto cloud_bounds(Point center, float radius, Point board_dims)
+    -> Rect {
   const auto padding = radius;
-  const auto bbox_lft = std::max(.0F, center.x - radius - padding);
-  const auto bbox_top = std::max(.0F, center.y - radius - padding);
-  const auto bounding_box = Rect{
-      bbox_lft,
-      bbox_top,
+  return Rect{
+      std::max(.0F, center.x - radius - padding),
+      std::max(.0F, center.y - radius - padding),
       std::min(_float(board_dims.x), center.x + radius + padding),
       std::min(_float(board_dims.y), center.y + radius + padding),
   };
-  qtree::Qtree quadtree{qtree::Qbound{bounding_box}};
-  auto poly_intersects = [&quadtree](const Polygon &p) {
-    return ranges::any_of(p.rects, [&quadtree](const Rect &r) {
-      return quadtree.rect_intersects(r);
+}
+
+// The polygons placed so far and the walks that place more of them, with
+// overlap tests on coordinates of type `T`, see Coordinates. `Index` is the
+// quadtree or polar::BasicPolarIndex, see CollisionIndex. make_cloud runs every
+// group through it once, PlacementSession also takes polygons out again
+template <typename T, typename Index = qtree::BasicQtree<T, false, true>>
+struct BasicPlacer {
+  using Hit = qtree::BasicQhit<T>;
+
+  Index index;
+  // Entries with an id are bounding boxes of the polygon in `bvhs[id]`
+  std::pmr::vector<BasicBvh<T>> bvhs;
+  std::pmr::vector<uint32_t> free_bvhs; // Of erased polygons, for reuse
+  std::pmr::vector<BasicRect<T>> bvh_rects;
+  // The last polygon probe's blocker, per walker. Cleared when moving on to
+  // another spiral or when a leaf splits. Point probes skip it: covered points
+  // are erased from the spiral, so they rarely hit a recent blocker again
+  BlockerCache<Hit> blockers;
+  std::size_t bvh_min_rects;
+  std::size_t probes = 0; // Spiral points tried, over all polygons
+  CloudStats stats;
+
+  // Per group counters are only allocated under RP_STATS
+  BasicPlacer(const Rect &bounds, [[maybe_unused]] std::size_t n_groups,
+              std::size_t bvh_min_rects, std::pmr::memory_resource *mem)
+      : index{qtree::BasicQbound<T>{covering<T>(bounds)}, mem}, bvhs{mem},
+        free_bvhs{mem}, bvh_rects{mem}, bvh_min_rects{bvh_min_rects},
+        stats{.groups = std::pmr::vector<GroupStats>(mem)} {
+#ifdef RP_STATS
+    stats.groups.resize(n_groups);
+#endif
+  }
+
+  // Tested within the leaf the blocker was found in, so that a hit is exactly
+  // what the index would answer
+  auto blocks(const Hit &b, const BasicRect<T> &r) const -> bool {
+    return b.leaf.rect.does_overlap(r) && b.value.rect.does_overlap(r) &&
+           (b.value.id == qtree::no_id || bvhs[b.value.id].intersects(r));
+  }
+
+  auto poly_intersects(const Polygon &p) -> bool {
+    const bool cached = blockers.find([&](const Hit &b) {
+      return ranges::any_of(p.rects, [&](const Rect &r) {
+        return blocks(b, covering<T>(r));
+      });
     });
-  };
-  auto poly_quadtree_insert = [&quadtree](const Polygon &p) {
-    for (const Rect &r : p.rects) {
-      quadtree.insert(r);
+    if (cached) {
+      RP_STAT(stats.blocker_hits++);
+      return true;
     }
-  };
+    return ranges::any_of(p.rects, [&](const Rect &r) {
+      const BasicRect<T> query = covering<T>(r);
+      const auto hit = index.rect_collider(query, [&](uint32_t id) {
+        return id == qtree::no_id || bvhs[id].intersects(query);
+      });
+      if (hit) {
+        blockers.push(*hit);
+      }
+      return hit.has_value();
+    });
+  }
+
+  auto point_intersects(Point p) -> bool {
+    const BasicPoint<T> query = coord_cast<T>(p);
+    return index.point_intersects(query, [&](uint32_t id) {
+      return id == qtree::no_id || bvhs[id].contains(query);
+    });
+  }
 
-  std::vector<Point> centers(spirals.size());
+  // Returns the BVH `p` went into, or qtree::no_id if its rects went into the
+  // index one by one
+  auto insert(const Polygon &p) -> uint32_t {
+    const std::size_t n_splits = index.splits();
+    const uint32_t bvh = insert_rects(p);
+    if (index.splits() != n_splits) {
+      blockers.clear();
+    }
+    return bvh;
+  }
 
-  int number_placed = 0;
-  for (std::size_t src = 0; src <= max_src_inx; ++src) {
-    auto &spiral = spirals[src];
-    auto &poly = polys[src];
-    for (auto it = spiral.begin(); it != spiral.end(); ++it) {
-      make_center_eq(*it, poly);
+  // `p` has to be where it was inserted, and `bvh` what insert returned
+  void erase(const Polygon &p, uint32_t bvh) {
+    blockers.clear();
+    if (bvh == qtree::no_id) {
+      for (const Rect &r : p.rects) {
+        index.erase(covering<T>(r));
+      }
+      return;
+    }
+    index.erase(bvhs[bvh].bound(), bvh);
+    bvhs[bvh].nodes.clear();
+    bvhs[bvh].rects.clear();
+    free_bvhs.push_back(bvh);
+  }
+
+  // Moves what is placed into an index over `bounds`. `bvh_of[i]` receives
+  // what insert returned for `polys[i]`
+  template <typename Placed>
+  void rebound(const Rect &bounds, std::span<const PolygonE> polys,
+               Placed placed, std::span<uint32_t> bvh_of) {
+    const QtreeStats qtree_stats = index.stats;
+    index = Index{qtree::BasicQbound<T>{covering<T>(bounds)}, index.resource()};
+    index.stats = qtree_stats;
+    bvhs.clear();
+    free_bvhs.clear();
+    blockers.clear();
+    for (std::size_t i = 0; i < polys.size(); ++i) {
+      if (placed(i)) {
+        bvh_of[i] = insert(polys[i]);
+      }
+    }
+  }
+
+  // Centers group polygon `poly` on the points of `spiral` in turn, from the
+  // `from`th on, and returns the first point where it fits.
+  //
+  // A `turned` polygon, see CloudOptions::rotate, is tried at every point
+  // where `poly` does not fit, and swapped with it if it fits there. It is
+  // tested against the blocker of `poly` first, which mostly blocks it as
+  // well, so both orientations usually cost a single index query
+  auto place_group([[maybe_unused]] std::size_t src, Spiral &spiral,
+                   PolygonE &poly, std::size_t from = 0,
+                   PolygonE *turned = nullptr) -> std::optional<Point> {
+    blockers.clear();
+    for (auto it = std::max(spiral.begin(), spiral.data.begin() + from);
+         it != spiral.end(); ++it) {
+      ++probes;
+      RP_STAT(stats.groups[src].probed++);
+      make_center_eq<T>(*it, poly);
       if (not poly_intersects(poly)) {
-        poly_quadtree_insert(poly);
-        centers[src] = *it;
-        number_placed++;
-        break;
+        return *it;
+      }
+      if (turned != nullptr) {
+        make_center_eq<T>(*it, *turned);
+        if (not poly_intersects(*turned)) {
+          std::swap(poly, *turned);
+          return *it;
+        }
       }
     }
+    return std::nullopt;
   }
 
-  for (auto [src, dst] : indices) {
-    CUSTOM_ASSERT(src < spirals.size());
-    CUSTOM_ASSERT(src < centers.size());
-    auto &spiral = spirals[src];
-    auto &poly = polys[dst];
-    for (auto it = spiral.begin() + 1; it != spiral.end(); ++it) {
-      if (quadtree.point_intersects(*it)) {
+  // Puts the edge of child `poly` facing `center` on the points of `spiral` in
+  // turn, dropping the points that turn out to be covered. A `turned` polygon
+  // is tried as in place_group, but first where it lies across the way to
+  // `center`, as it then wraps around the group rather than sticking out
+  auto place_child([[maybe_unused]] std::size_t src, Spiral &spiral,
+                   Point center, PolygonE &poly, std::size_t from = 0,
+                   PolygonE *turned = nullptr) -> bool {
+    spiral.aim(center);
+    for (auto it = std::max(spiral.begin() + 1, spiral.data.begin() + from);
+         it != spiral.end(); ++it) {
+      ++probes;
+      RP_STAT(stats.groups[src].probed++);
+      if (point_intersects(*it)) {
+        RP_STAT(stats.groups[src].erased++);
         spiral.erase(it);
         continue;
       }
-      auto theta = edge_angle(*it, centers[src]);
-      Point closest_isect;
-      if (not poly.closest_isect(theta, closest_isect)) {
+      const Point dir = spiral.direction(it);
+      PolygonE *first = &poly;
+      PolygonE *second = turned;
+      if (turned != nullptr && lies_across(*turned, dir)) {
+        std::swap(first, second);
+      }
+      for (PolygonE *p : {first, second}) {
+        if (p != nullptr && fits_facing(*p, *it, dir)) {
+          if (p == turned) {
+            std::swap(poly, *turned);
+          }
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+private:
+  // Whether the long side of the bounding box of `p` lies across `dir`
+  static auto lies_across(const PolygonE &p, Point dir) -> bool {
+    const Rect b = bvh_union<float>(p.rects);
+    return b.w() != b.h() &&
+           (b.w() < b.h()) == (std::abs(dir.x) > std::abs(dir.y));
+  }
+  // Moves the edge of `poly` that a ray from its center along `dir` hits onto
+  // `p`, and returns whether it fits there
+  auto fits_facing(PolygonE &poly, Point p, Point dir) -> bool {
+    RP_STAT(stats.closest_isect++);
+    Point closest_isect;
+    if (not poly.closest_isect(dir, closest_isect)) {
+      return false;
+    }
+    poly.move_by(snap<T>(p - closest_isect));
+    return not poly_intersects(poly);
+  }
+
+  auto insert_rects(const Polygon &p) -> uint32_t {
+    if (p.rects.size() < bvh_min_rects) {
+      for (const Rect &r : p.rects) {
+        index.insert(covering<T>(r));
+      }
+      return qtree::no_id;
+    }
+    // As the index drops rects outside of its bounds, so does the BVH
+    bvh_rects.clear();
+    for (const Rect &r : p.rects) {
+      if (const BasicRect<T> rect = covering<T>(r);
+          index.root_bound.rect.does_overlap(rect)) {
+        bvh_rects.push_back(rect);
+      }
+    }
+    if (bvh_rects.empty()) {
+      return qtree::no_id;
+    }
+    uint32_t bvh = bvhs.size();
+    if (free_bvhs.empty()) {
+      bvhs.push_back(make_bvh<T>(bvh_rects, bvhs.get_allocator().resource()));
+    } else {
+      bvh = free_bvhs.back();
+      free_bvhs.pop_back();
+      bvhs[bvh] = make_bvh<T>(bvh_rects, bvhs.get_allocator().resource());
+    }
+    index.insert(bvhs[bvh].bound(), bvh);
+    return bvh;
+  }
+};
+
+// Appends the points of the spiral of `slice` on a circle grown to `radius`
+// that lie farther out than any point of `s`. Returns how many
+inline auto grow_spiral(Spiral &s, Slice slice, float radius,
+                        std::pmr::memory_resource *mem) -> std::size_t {
+  const Point center = slice.circ.center;
+  float reach = 0.F;
+  for (const Point p : s.data) {
+    reach = std::max(reach, norm(p, center));
+  }
+  slice.circ.radius = radius;
+  const Spiral grown = spiral(slice, mem);
+  std::pmr::vector<Point> outer(mem);
+  std::ranges::copy_if(grown.data, std::back_inserter(outer),
+                       [&](Point p) { return norm(p, center) > reach; });
+  s.append(outer);
+  return outer.size();
+}
+
+// Pulls the placed polygons `moving` toward their `targets`, nearest first.
+// In each round every polygon takes one step straight toward its target, or
+// else along x or y only, if that does not overlap anything. Steps are half
+// the smallest side of any of their rects, so that nothing jumps over a
+// polygon in its way. `bvh_of` is kept up to date as polygons are moved in the
+// placer. Returns the number of rounds run, which ends early once nothing
+// moves, see CloudOptions::compaction_rounds
+template <typename T, typename Index>
+inline auto compact(BasicPlacer<T, Index> &placer, std::span<PolygonE> polys,
+                    std::span<std::size_t> moving,
+                    std::span<const Point> targets,
+                    std::span<uint32_t> bvh_of, const CloudOptions &opts,
+                    std::pmr::memory_resource *mem) -> std::size_t {
+  using Clock = std::chrono::steady_clock;
+  const auto deadline =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double, std::milli>{
+                             opts.compaction_ms});
+  auto out_of_time = [&] {
+    return opts.compaction_ms > 0 && Clock::now() >= deadline;
+  };
+  auto center = [](const PolygonE &p) {
+    return bvh_union<float>(p.rects).center();
+  };
+
+  float step = std::numeric_limits<float>::max();
+  for (const std::size_t i : moving) {
+    for (const Rect &r : polys[i].rects) {
+      step = std::min({step, r.w() / 2, r.h() / 2});
+    }
+  }
+  if constexpr (std::is_integral_v<T>) {
+    step = std::max(std::round(step), 1.F);
+  }
+  std::ranges::sort(moving, _lt_, [&](std::size_t i) {
+    return norm(center(polys[i]), targets[i]);
+  });
+
+  Polygon probe{Bounds(mem)};
+  std::size_t rounds = 0;
+  bool moved = true;
+  while (moved && rounds < opts.compaction_rounds && not out_of_time()) {
+    ++rounds;
+    moved = false;
+    for (const std::size_t i : moving) {
+      PolygonE &p = polys[i];
+      const Point to = targets[i] - center(p);
+      const float dist = std::hypot(to.x, to.y);
+      if (dist < step || out_of_time()) {
         continue;
       }
-      poly.move_by(*it - closest_isect);
-      if (not poly_intersects(poly)) {
-        poly_quadtree_insert(poly);
+      const Point d = to * (step / dist);
+      placer.erase(p, bvh_of[i]);
+      for (const Point v : {d, Point{d.x, 0}, Point{0, d.y}}) {
+        const Point s = snap<T>(v);
+        if (s == Point{0, 0}) {
+          continue;
+        }
+        probe.rects.assign(p.rects.begin(), p.rects.end());
+        for (Rect &r : probe.rects) {
+          r.lft += s.x;
+          r.rgt += s.x;
+          r.top += s.y;
+          r.bot += s.y;
+        }
+        if (not placer.poly_intersects(probe)) {
+          p.move_by(s);
+          moved = true;
+          break;
+        }
+      }
+      bvh_of[i] = placer.insert(p);
+    }
+  }
+  return rounds;
+}
+
+// Places every group into the free space of its slice, roots first, see
+// Engine::Frontier. A slice reaches as far as its spiral would, up to twice as
+// far from its centroid as the slice itself
+template <typename T>
+inline auto basic_make_frontier_cloud(std::span<PolygonE> polys,
+                                      const GroupIndex &groups,
+                                      std::span<const Slice> slices,
+                                      const Rect &bounds,
+                                      std::pmr::memory_resource *mem)
+    -> Cloud {
+  std::pmr::vector<BasicRect<T>> reaches(mem);
+  reaches.reserve(slices.size());
+  for (const Slice &slice : slices) {
+    const Point c = slice.centroid();
+    Rect reach{c.x, c.y, c.x, c.y};
+    for (const Point p : slice.points<100>().data) {
+      const Point q = c + (p - c) * 2.F;
+      reach = {std::min(reach.lft, q.x), std::min(reach.top, q.y),
+               std::max(reach.rgt, q.x), std::max(reach.bot, q.y)};
+    }
+    reaches.push_back(covering<T>(reach));
+  }
+
+  auto bound = [](const PolygonE &p) {
+    return covering<T>(bvh_union<float>(p.rects));
+  };
+  T min_w = std::numeric_limits<T>::max();
+  T min_h = std::numeric_limits<T>::max();
+  for (const PolygonE &p : polys) {
+    const BasicRect<T> b = bound(p);
+    min_w = std::min(min_w, b.w());
+    min_h = std::min(min_h, b.h());
+  }
+
+  BasicFrontier<T> frontier{covering<T>(bounds), mem};
+  std::size_t probes = 0;
+  int number_placed = 0;
+  std::pmr::vector<bool> placed(polys.size(), false, mem);
+  auto place = [&](std::size_t src, std::size_t i) {
+    PolygonE &poly = polys[i];
+    const auto at = frontier.fit(bound(poly), slices[src].centroid(),
+                                 reaches[src], probes);
+    if (not at) {
+      return;
+    }
+    poly.move_by(*at);
+    frontier.carve(bound(poly), min_w, min_h);
+    placed[i] = true;
+    number_placed++;
+  };
+  {
+    RP_TRACE_SCOPE("group placement");
+    for (std::size_t src = 0; src < groups.size(); ++src) {
+      place(src, src);
+    }
+  }
+  RP_TRACE_SCOPE("child placement");
+  for (std::size_t src = 0; src < groups.size(); ++src) {
+    RP_TRACE_SCOPE_ARG("group", src);
+    for (std::size_t dst : groups.group(src)) {
+      place(src, dst);
+    }
+  }
+  return {
+      .number_placed = number_placed,
+      .placed = std::move(placed),
+      .spirals = std::pmr::vector<Spiral>(mem),
+      .radius = slices.front().circ.radius,
+      .probes = probes,
+  };
+}
+
+// Places with overlap tests on coordinates of type `T`, see Coordinates, in
+// an `Index` of them, see CollisionIndex
+template <typename T, typename Index = qtree::BasicQtree<T, false, true>>
+inline auto basic_make_cloud(std::span<PolygonE> polys,
+                             std::span<const IndexPair> indices,
+                             Point board_dims, const CloudOptions &opts,
+                             std::pmr::memory_resource *mem) -> Cloud {
+  CUSTOM_ASSERT(!polys.empty());
+  CUSTOM_ASSERT(opts.max_growths == 0 || opts.growth_factor > 1.F);
+
+  RP_TRACE_SCOPE("make_cloud");
+
+  const GroupIndex groups = [&] {
+    RP_TRACE_SCOPE("area accumulation");
+    return make_group_index(polys, indices, opts.sort_children_by_area, mem);
+  }();
+  const auto &areas = groups.areas;
+  const float total_area = accumulate(areas, 0.F);
+  const float radius = std::sqrt(total_area / M_PI);
+  const Point center = board_dims.center();
+  const Circ circ{center, radius};
+
+  const auto slices = [&] {
+    RP_TRACE_SCOPE("split");
+    return circ.split(areas, mem);
+  }();
+  if (opts.engine == Engine::Frontier) {
+    return basic_make_frontier_cloud<T>(
+        polys, groups, slices, cloud_bounds(center, radius, board_dims), mem);
+  }
+  std::pmr::vector<Spiral> spirals(mem);
+  std::pmr::vector<Spiral> spirals_cp(mem);
+  {
+    RP_TRACE_SCOPE("spiral generation");
+    spirals.reserve(slices.size());
+    spirals_cp.reserve(slices.size());
+    for (const Slice &slice : slices) {
+      spirals.push_back(spiral(slice, mem));
+      // Copied member-wise `slow` would still point into `spirals`
+      spirals_cp.push_back(Spiral{{spirals.back().data, mem}});
+    }
+  }
+  CUSTOM_ASSERT(spirals.size() == areas.size());
+
+  BasicPlacer<T, Index> placer{cloud_bounds(center, radius, board_dims),
+                               groups.size(), opts.bvh_min_rects, mem};
+  // The other orientation of every polygon that has one, see
+  // CloudOptions::rotate. Polygons that look the same turned have none, and
+  // compounds are never turned, as their members would have to turn as well
+  std::pmr::vector<std::optional<PolygonE>> turns(mem);
+  if (opts.rotate) {
+    turns.reserve(polys.size());
+    for (const PolygonE &p : polys) {
+      std::optional<PolygonE> t = p.compound ? std::nullopt : turned(p);
+      if (t && t->rects == p.rects) {
+        t.reset();
+      }
+      turns.push_back(std::move(t));
+    }
+  }
+  auto turn = [&turns](std::size_t i) -> PolygonE * {
+    return turns.empty() || not turns[i] ? nullptr : &*turns[i];
+  };
+  std::pmr::vector<Point> centers(spirals.size(), mem);
+  std::pmr::vector<bool> placed(polys.size(), false, mem);
+  // Of the placed polygons, as returned by BasicPlacer::insert
+  std::pmr::vector<uint32_t> bvh_of(polys.size(), qtree::no_id, mem);
+  // Of the placed polygons, the centroid of the slice they were placed in
+  std::pmr::vector<Point> targets(polys.size(), mem);
+  int number_placed = 0;
+  // Spiral points before the `from[src]`th were tried by every polygon of
+  // group `src` that is left over
+  auto place_groups = [&](std::span<const std::size_t> from) {
+    RP_TRACE_SCOPE("group placement");
+    for (std::size_t src = 0; src < groups.size(); ++src) {
+      if (placed[src] || from[src] == spirals[src].data.size()) {
+        continue;
+      }
+      if (const auto at =
+              placer.place_group(src, spirals[src], polys[src], from[src],
+                                 turn(src))) {
+        bvh_of[src] = placer.insert(polys[src]);
+        targets[src] = slices[src].centroid();
+        centers[src] = *at;
+        placed[src] = true;
         number_placed++;
-        break;
       }
     }
+  };
+  // Children are visited group by group, so consecutive placements stay within
+  // one spiral and one region of the quadtree
+  auto place_children = [&](std::span<const std::size_t> from) {
+    RP_TRACE_SCOPE("child placement");
+    for (std::size_t src = 0; src < groups.size(); ++src) {
+      if (from[src] == spirals[src].data.size()) {
+        continue;
+      }
+      RP_TRACE_SCOPE_ARG("group", src);
+      placer.blockers.clear();
+      for (std::size_t dst : groups.group(src)) {
+        if (not placed[dst] &&
+            placer.place_child(src, spirals[src], centers[src], polys[dst],
+                               from[src], turn(dst))) {
+          bvh_of[dst] = placer.insert(polys[dst]);
+          targets[dst] = slices[src].centroid();
+          placed[dst] = true;
+          number_placed++;
+        }
+      }
+    }
+  };
+  std::pmr::vector<std::size_t> from(groups.size(), 0, mem);
+  place_groups(from);
+  place_children(from);
+
+  const auto n_members = _int(groups.size() + groups.children.size());
+  float grown_radius = radius;
+  std::size_t growths = 0;
+  for (; number_placed < n_members && growths < opts.max_growths; ++growths) {
+    RP_TRACE_SCOPE("growth");
+    grown_radius *= opts.growth_factor;
+    placer.rebound(cloud_bounds(center, grown_radius, board_dims), polys,
+                   [&placed](std::size_t i) -> bool { return placed[i]; },
+                   bvh_of);
+    for (std::size_t src = 0; src < groups.size(); ++src) {
+      Spiral &s = spirals[src];
+      from[src] = s.data.size();
+      const auto group = groups.group(src);
+      if (placed[src] && ranges::all_of(group, [&](std::size_t dst) -> bool {
+            return placed[dst];
+          })) {
+        continue;
+      }
+      const std::size_t n = grow_spiral(s, slices[src], grown_radius, mem);
+      spirals_cp[src].append(std::span{s.data}.last(n));
+    }
+    place_groups(from);
+    place_children(from);
+  }
+
+  std::size_t compaction_rounds = 0;
+  if (opts.compaction_rounds > 0) {
+    RP_TRACE_SCOPE("compaction");
+    std::pmr::vector<std::size_t> moving(mem);
+    for (std::size_t i = 0; i < polys.size(); ++i) {
+      if (placed[i]) {
+        moving.push_back(i);
+      }
+    }
+    compaction_rounds =
+        compact(placer, polys, moving, targets, bvh_of, opts, mem);
   }
 
-  return {number_placed, std::move(spirals_cp)};
+  placer.stats.qtree = placer.index.stats;
+  return {
+      .number_placed = number_placed,
+      .placed = std::move(placed),
+      .spirals = std::move(spirals_cp),
+      .radius = grown_radius,
+      .growths = growths,
+      .compaction_rounds = compaction_rounds,
+      .probes = placer.probes,
+      .stats = std::move(placer.stats),
+      .qtree_memory = placer.index.memory_stats(),
+  };
+}
+
+// The largest width or height of the bounding box of any of `polys`
+inline auto max_extent(std::span<const PolygonE> polys) -> float {
+  float extent = 0.F;
+  for (const PolygonE &p : polys) {
+    if (p.rects.empty()) {
+      continue;
+    }
+    Rect box = p.rects.front();
+    for (const Rect &r : p.rects) {
+      box = {std::min(box.lft, r.lft), std::min(box.top, r.top),
+             std::max(box.rgt, r.rgt), std::max(box.bot, r.bot)};
+    }
+    extent = std::max({extent, box.w(), box.h()});
+  }
+  return extent;
+}
+
+// The radius of a cloud of polygons of `area`, grown as far as `opts` lets it
+inline auto max_radius(float area, const CloudOptions &opts) -> float {
+  float radius = std::sqrt(area / M_PI);
+  if (opts.max_growths > 0) {
+    radius *= std::pow(opts.growth_factor, _float(opts.max_growths));
+  }
+  return radius;
+}
+
+// Whether the leaf entries of a quadtree of a cloud of `polys` fit in 16 bits.
+// They are offsets from the top left corner of their leaf, of rects that
+// overlap the quadtree bounds, so less than the extent of the bounds plus that
+// of the largest polygon. The bounds are within twice the radius around the
+// center, grown as far as it may grow, and within the board
+inline auto fits_int16(std::span<const PolygonE> polys, Point board_dims,
+                       const CloudOptions &opts) -> bool {
+  const float area = accumulate(polys, 0.F, _plus_, &Polygon::area);
+  const float bounds = std::min(4 * max_radius(area, opts),
+                                std::max(board_dims.x, board_dims.y));
+  // Rounded out to whole units on both sides, see covering
+  return bounds + max_extent(polys) + 4 <=
+         std::numeric_limits<std::int16_t>::max();
+}
+
+inline auto make_cloud(std::span<PolygonE> polys,
+                       std::span<const IndexPair> indices, Point board_dims,
+                       const CloudOptions &opts = {},
+                       std::pmr::memory_resource *mem =
+                           std::pmr::get_default_resource())
+    -> Cloud {
+  const bool polar = opts.index == CollisionIndex::Polar;
+  switch (opts.coordinates) {
+  case Coordinates::Int32:
+    using I = std::int32_t;
+    if (polar) {
+      return basic_make_cloud<I, polar::BasicPolarIndex<I>>(
+          polys, indices, board_dims, opts, mem);
+    }
+    if (opts.index == CollisionIndex::Quadtree16 &&
+        fits_int16(polys, board_dims, opts)) {
+      return basic_make_cloud<I, qtree::BasicQtree<I, true, true>>(
+          polys, indices, board_dims, opts, mem);
+    }
+    return basic_make_cloud<I>(polys, indices, board_dims, opts, mem);
+  case Coordinates::Float:
+    break;
+  }
+  return polar ? basic_make_cloud<float, polar::PolarIndex>(
+                     polys, indices, board_dims, opts, mem)
+               : basic_make_cloud<float>(polys, indices, board_dims, opts, mem);
 }
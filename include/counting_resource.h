@@ -0,0 +1,36 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+
+// Forwards to `upstream` and records how much was requested from it. Used as
+// the upstream of an arena it measures the memory footprint of a job
+struct CountingResource : std::pmr::memory_resource {
+  std::pmr::memory_resource *upstream = std::pmr::new_delete_resource();
+  std::size_t allocated = 0; // Total over the lifetime of the resource
+  std::size_t in_use = 0;
+  std::size_t peak = 0;
+
+  explicit CountingResource(std::pmr::memory_resource *upstream =
+                                std::pmr::new_delete_resource())
+      : upstream{upstream} {}
+
+private:
+  auto do_allocate(std::size_t bytes, std::size_t align) -> void * override {
+    void *p = upstream->allocate(bytes, align);
+    allocated += bytes;
+    in_use += bytes;
+    peak = std::max(peak, in_use);
+    return p;
+  }
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t align) override {
+    upstream->deallocate(p, bytes, align);
+    in_use -= bytes;
+  }
+  auto do_is_equal(const std::pmr::memory_resource &other) const noexcept
+      -> bool override {
+    return this == &other;
+  }
+};
@@ -12,6 +12,14 @@ inline constexpr auto current() -> const char * { return ""; }
 
 #define P(X) std::cout << #X << ": " << X << std::endl
 
+// Hot path instrumentation, see stats.h. The expression is not even compiled
+// unless RP_STATS is defined
+#ifdef RP_STATS
+#define RP_STAT(expr) (expr)
+#else
+#define RP_STAT(expr) ((void)0)
+#endif
+
 #ifndef NDEBUG
 #include <iostream>
 #define CUSTOM_ASSERT(condition, ...)                                          \
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "rect.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
+
+// Free space as a list of maximal free rects: every free point of the region
+// it was made for lies in at least one of them, and none of them lies inside
+// another. Instead of probing points for a polygon, its bounding box is moved
+// into the free rect that lets it come closest to a target, and what it covers
+// is then cut out of every free rect it overlaps.
+//
+// Free rects clipped to a part of the region are the maximal free rects of
+// that part, so a single frontier serves every slice of the circle
+template <typename T> struct BasicFrontier {
+  std::pmr::vector<BasicRect<T>> free;
+  std::pmr::vector<BasicRect<T>> pieces; // Scratch of `carve`
+
+  BasicFrontier(const BasicRect<T> &region, std::pmr::memory_resource *mem)
+      : free{{region}, mem}, pieces{mem} {}
+
+  // Offset that moves `bound` into a free rect clipped to `within` with its
+  // center closest to `target`, none if it fits in none of them. Adds the free
+  // rects looked at to `probes`
+  auto fit(const BasicRect<T> &bound, Point target,
+           const BasicRect<T> &within, std::size_t &probes) const
+      -> std::optional<Point> {
+    const Point want = target - Point{_float(bound.lft + bound.rgt) / 2,
+                                      _float(bound.top + bound.bot) / 2};
+    std::optional<Point> result;
+    float best = std::numeric_limits<float>::max();
+    for (const BasicRect<T> &free_rect : free) {
+      ++probes;
+      const BasicRect<T> f{
+          std::max(free_rect.lft, within.lft),
+          std::max(free_rect.top, within.top),
+          std::min(free_rect.rgt, within.rgt),
+          std::min(free_rect.bot, within.bot),
+      };
+      if (f.w() < bound.w() || f.h() < bound.h()) {
+        continue;
+      }
+      const auto x = fit_offset(bound.lft, bound.rgt, f.lft, f.rgt, want.x);
+      const auto y = fit_offset(bound.top, bound.bot, f.top, f.bot, want.y);
+      if (not x || not y) {
+        continue;
+      }
+      const float dist = (*x - want.x) * (*x - want.x) +
+                         (*y - want.y) * (*y - want.y);
+      if (dist < best) {
+        best = dist;
+        result = Point{*x, *y};
+      }
+    }
+    return result;
+  }
+
+  // Cuts `used` out of the free rects. Pieces narrower than `min_w` or lower
+  // than `min_h` can not hold any polygon and are dropped as well
+  void carve(const BasicRect<T> &used, T min_w, T min_h) {
+    pieces.clear();
+    auto add = [&](const BasicRect<T> &p) {
+      if (p.w() >= min_w && p.h() >= min_h) {
+        pieces.push_back(p);
+      }
+    };
+    std::size_t kept = 0;
+    for (const BasicRect<T> f : free) {
+      if (not f.does_overlap(used)) {
+        free[kept++] = f;
+        continue;
+      }
+      if (used.lft > f.lft) {
+        add({f.lft, f.top, used.lft, f.bot});
+      }
+      if (used.rgt < f.rgt) {
+        add({used.rgt, f.top, f.rgt, f.bot});
+      }
+      if (used.top > f.top) {
+        add({f.lft, f.top, f.rgt, used.top});
+      }
+      if (used.bot < f.bot) {
+        add({f.lft, used.bot, f.rgt, f.bot});
+      }
+    }
+    free.resize(kept);
+
+    // Rects that were not cut stay maximal, as a piece lies within the rect it
+    // was cut from. Pieces are only kept if nothing else contains them, of
+    // equal pieces the first one
+    for (std::size_t i = 0; i < pieces.size(); ++i) {
+      const BasicRect<T> &p = pieces[i];
+      auto contains_p = [&p](const BasicRect<T> &o) {
+        return o.lft <= p.lft && o.top <= p.top && p.rgt <= o.rgt &&
+               p.bot <= o.bot;
+      };
+      bool covered = std::any_of(free.begin(), free.begin() + kept, contains_p);
+      for (std::size_t j = 0; j < pieces.size() && not covered; ++j) {
+        covered = j != i && contains_p(pieces[j]) &&
+                  (j < i || not(pieces[j] == p));
+      }
+      if (not covered) {
+        free.push_back(p);
+      }
+    }
+  }
+
+private:
+  // Offset closest to `want` that moves [lo, hi] into [free_lo, free_hi]. On
+  // an integer grid offsets are whole, on floats they are nudged so that the
+  // rounded sums stay inside
+  static auto fit_offset(T lo, T hi, T free_lo, T free_hi, float want)
+      -> std::optional<float> {
+    if constexpr (std::is_integral_v<T>) {
+      const auto min = _float(free_lo - lo);
+      const auto max = _float(free_hi - hi);
+      return min <= max ? std::optional{std::clamp(std::round(want), min, max)}
+                        : std::nullopt;
+    } else {
+      T min = free_lo - lo;
+      T max = free_hi - hi;
+      while (lo + min < free_lo) {
+        min = std::nextafter(min, std::numeric_limits<T>::infinity());
+      }
+      while (hi + max > free_hi) {
+        max = std::nextafter(max, -std::numeric_limits<T>::infinity());
+      }
+      return min <= max ? std::optional{std::clamp(want, min, max)}
+                        : std::nullopt;
+    }
+  }
+};
+
+using Frontier = BasicFrontier<float>;
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "circ.h"
+#include "defines.h"
+#include "polygon.h"
+
+#include <memory_resource>
+#include <span>
+
+// Group -> children adjacency in compressed sparse row form. Children of group
+// `src` are `children[offsets[src] .. offsets[src + 1])`, in input order unless
+// sorted by area
+struct GroupIndex {
+  std::pmr::vector<std::size_t> offsets;
+  std::pmr::vector<std::size_t> children;
+  std::pmr::vector<float> areas; // Group area, i.e. `src` plus its children
+
+  auto size() const -> std::size_t { return areas.size(); }
+  auto group(std::size_t src) const -> std::span<const std::size_t> {
+    return std::span{children}.subspan(offsets[src],
+                                       offsets[src + 1] - offsets[src]);
+  }
+};
+
+inline auto make_group_index(std::span<const PolygonE> polys,
+                             std::span<const IndexPair> indices,
+                             bool sort_by_area,
+                             std::pmr::memory_resource *mem =
+                                 std::pmr::get_default_resource())
+    -> GroupIndex {
+  CUSTOM_ASSERT(!indices.empty());
+
+  std::size_t max_src_inx = 0;
+  for (auto [src, dst] : indices) {
+    CUSTOM_ASSERT(src < polys.size());
+    CUSTOM_ASSERT(dst < polys.size());
+    CUSTOM_ASSERT(src != dst);
+    max_src_inx = std::max(max_src_inx, src);
+  }
+  const std::size_t n_groups = max_src_inx + 1;
+
+  GroupIndex result{
+      .offsets = std::pmr::vector<std::size_t>(n_groups + 1, 0, mem),
+      .children = std::pmr::vector<std::size_t>(indices.size(), mem),
+      .areas = std::pmr::vector<float>(n_groups, 0.F, mem),
+  };
+
+  // Counting sort by `src`, stable with respect to the input order
+  for (auto [src, _] : indices) {
+    result.offsets[src + 1]++;
+  }
+  for (std::size_t i = 0; i < n_groups; ++i) {
+    result.offsets[i + 1] += result.offsets[i];
+  }
+  std::pmr::vector<std::size_t> next(result.offsets.begin(),
+                                     result.offsets.end() - 1, mem);
+  for (auto [src, dst] : indices) {
+    result.children[next[src]++] = dst;
+  }
+
+  std::pmr::vector<std::pair<float, std::size_t>> by_area(mem);
+  for (std::size_t src = 0; src < n_groups; ++src) {
+    const auto group = result.group(src);
+    if (group.empty()) {
+      continue;
+    }
+    by_area.clear();
+    float &area = result.areas[src] = polys[src].area();
+    for (std::size_t dst : group) {
+      by_area.emplace_back(polys[dst].area(), dst);
+      area += by_area.back().first;
+    }
+    if (sort_by_area) {
+      std::ranges::stable_sort(by_area, _gt_,
+                               &std::pair<float, std::size_t>::first);
+      auto out = result.children.begin() + result.offsets[src];
+      for (auto [_, dst] : by_area) {
+        *out++ = dst;
+      }
+    }
+  }
+  CUSTOM_ASSERT(all_of(result.areas, _gt(0.F)));
+  return result;
+}
@@ -0,0 +1,402 @@
+#pragma once
+
+#include "cloud.h"
+#include "defines.h"
+#include "group_index.h"
+#include "polygon.h"
+#include "rect.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <exception>
+#include <limits>
+#include <memory_resource>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Index pairs may nest: a child that has children of its own is an inner
+// group. Every inner group is first packed on its own, into a cloud of itself
+// and its children, and then takes part in the cloud of its parent as a single
+// rigid polygon, its compound. Sub-clouds whose inner groups are done do not
+// depend on each other and are placed on several threads.
+//
+// An inner group, and every child of one, has a single parent. Index pairs
+// without inner groups are placed by make_cloud as they are
+namespace hierarchy {
+
+constexpr std::size_t no_parent = std::numeric_limits<std::size_t>::max();
+
+// Threads to place `n_tasks` sub-clouds on, see CloudOptions::threads
+inline auto thread_count(std::size_t requested, std::size_t n_tasks)
+    -> std::size_t {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+  requested = 1;
+#endif
+  if (requested == 0) {
+    requested = std::max(1U, std::thread::hardware_concurrency());
+  }
+  return std::max<std::size_t>(std::min(requested, n_tasks), 1);
+}
+
+// Calls `f(i, worker)` for every `i < n` on up to `threads` threads, the
+// calling one included, with `worker < threads` the one it runs on. The first
+// exception thrown by `f` is rethrown once all of them are done, tasks not yet
+// started are then skipped
+template <typename F>
+inline void for_each_parallel(std::size_t n, std::size_t threads, F f) {
+  if (threads <= 1) {
+    for (std::size_t i = 0; i < n; ++i) {
+      f(i, std::size_t{0});
+    }
+    return;
+  }
+  std::atomic<std::size_t> next = 0;
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto work = [&](std::size_t worker) {
+    for (std::size_t i = next++; i < n; i = next++) {
+      try {
+        f(i, worker);
+      } catch (...) {
+        const std::scoped_lock lock{error_mutex};
+        if (not error) {
+          error = std::current_exception();
+        }
+        next = n;
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+  for (std::size_t t = 1; t < threads; ++t) {
+    try {
+      workers.emplace_back(work, t);
+    } catch (const std::system_error &) {
+      break; // Out of threads, the ones started do the rest
+    }
+  }
+  work(0);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// Outline around `rects` as columns between their distinct x coordinates, each
+// from the highest top to the lowest bottom of the rects across it. It holds
+// all of them and, unlike their union, is a polygon make_cloud can place.
+// Columns that no rect crosses are as high as the one before
+inline auto column_hull(std::span<const Rect> rects,
+                        std::pmr::memory_resource *mem) -> Bounds {
+  CUSTOM_ASSERT(not rects.empty());
+  std::pmr::vector<float> xs(mem);
+  xs.reserve(2 * rects.size());
+  for (const Rect &r : rects) {
+    xs.push_back(r.lft);
+    xs.push_back(r.rgt);
+  }
+  std::ranges::sort(xs);
+  xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+
+  Bounds result(mem);
+  for (std::size_t i = 0; i + 1 < xs.size(); ++i) {
+    Rect column{xs[i], std::numeric_limits<float>::max(), xs[i + 1],
+                std::numeric_limits<float>::lowest()};
+    for (const Rect &r : rects) {
+      if (r.lft <= column.lft && column.rgt <= r.rgt) {
+        column.top = std::min(column.top, r.top);
+        column.bot = std::max(column.bot, r.bot);
+      }
+    }
+    if (column.top > column.bot) {
+      column.top = result.back().top;
+      column.bot = result.back().bot;
+    }
+    if (not result.empty() && result.back().top == column.top &&
+        result.back().bot == column.bot) {
+      result.back().rgt = column.rgt;
+    } else {
+      result.push_back(column);
+    }
+  }
+  return result;
+}
+
+// A copy of `p` allocated from `mem`
+inline auto copy_polygon(const PolygonE &p, std::pmr::memory_resource *mem)
+    -> PolygonE {
+  PolygonE result{Polygon{Bounds(p.rects.begin(), p.rects.end(), mem)}};
+  result.compound = p.compound;
+  return result;
+}
+
+// Polygons of one cloud, in an arena of their own on `upstream`, and where
+// they were placed
+struct SubCloud {
+  explicit SubCloud(std::pmr::memory_resource *upstream) : arena{upstream} {}
+
+  std::pmr::monotonic_buffer_resource arena;
+  std::pmr::vector<PolygonE> polys{&arena};
+  // Constructed in place, as assigning it would copy it out of `arena`
+  std::optional<Cloud> cloud;
+};
+
+// Cloud of `members`, the first of them the group of all the others
+inline void place_sub_cloud(SubCloud &sub, std::span<const PolygonE *> members,
+                            const CloudOptions &opts) {
+  sub.polys.reserve(members.size());
+  for (const PolygonE *p : members) {
+    sub.polys.push_back(copy_polygon(*p, &sub.arena));
+  }
+  if (members.size() == 1) {
+    sub.cloud.emplace(Cloud{
+        .number_placed = 1,
+        .placed = std::pmr::vector<bool>(1, true, &sub.arena),
+    });
+    return;
+  }
+  std::pmr::vector<IndexPair> pairs(&sub.arena);
+  for (std::size_t i = 1; i < members.size(); ++i) {
+    pairs.push_back({.src = 0, .dst = i});
+  }
+  // Wide enough for the quadtree bounds, twice the radius around the center,
+  // never to be clipped to the board: four times the radius grown as far as it
+  // may grow, see fits_int16, with room for the largest member on either side,
+  // and at least eight times the radius before growth. On whole units for
+  // Coordinates::Int32
+  const float area = accumulate(sub.polys, 0.F, _plus_, &Polygon::area);
+  const float side = std::ceil(
+      std::max<double>(8 * std::sqrt(area / M_PI),
+                       4 * max_radius(area, opts) + 2 * max_extent(sub.polys)));
+  sub.cloud.emplace(
+      make_cloud(sub.polys, pairs, {side, side}, opts, &sub.arena));
+}
+
+} // namespace hierarchy
+
+// Like make_cloud, for index pairs that may nest, see above. Every polygon is
+// moved to where it ends up, and counts as placed if it was placed within its
+// own group and the compounds of all the inner groups around it were placed.
+// The spirals, radius and counters are those of the outermost cloud, apart
+// from `probes`, which adds up those of all of them
+inline auto make_nested_cloud(std::span<PolygonE> polys,
+                              std::span<const IndexPair> indices,
+                              Point board_dims, const CloudOptions &opts = {},
+                              std::pmr::memory_resource *mem =
+                                  std::pmr::get_default_resource())
+    -> Cloud {
+  using hierarchy::no_parent;
+  const std::size_t n = polys.size();
+  std::pmr::vector<std::size_t> parent(n, no_parent, mem); // The first one
+  std::pmr::vector<bool> has_children(n, false, mem);
+  for (const auto [src, dst] : indices) {
+    CUSTOM_ASSERT(src < n && dst < n);
+    has_children[src] = true;
+    if (parent[dst] == no_parent) {
+      parent[dst] = src;
+    }
+  }
+  auto is_inner = [&](std::size_t i) -> bool {
+    return i != no_parent && parent[i] != no_parent && has_children[i];
+  };
+  std::pmr::vector<std::size_t> inner(mem);
+  std::pmr::vector<std::size_t> slot(n, no_parent, mem); // Into `inner`
+  for (std::size_t i = 0; i < n; ++i) {
+    if (is_inner(i)) {
+      slot[i] = inner.size();
+      inner.push_back(i);
+    }
+  }
+  if (inner.empty()) {
+    return make_cloud(polys, indices, board_dims, opts, mem);
+  }
+  for (const auto [src, dst] : indices) {
+    CUSTOM_ASSERT(parent[dst] == src || not(is_inner(src) || is_inner(dst)));
+  }
+
+  // Inner groups by the number of inner groups around them. Those of one depth
+  // are placed together, the deepest first
+  std::pmr::vector<std::size_t> depth(inner.size(), no_parent, mem);
+  for (std::size_t s = 0; s < inner.size(); ++s) {
+    std::size_t steps = 0;
+    std::size_t i = inner[s];
+    for (; depth[slot[i]] == no_parent && is_inner(parent[i]); i = parent[i]) {
+      CUSTOM_ASSERT(++steps <= inner.size()); // Not a cycle
+    }
+    const std::size_t d = depth[slot[i]] == no_parent ? 0 : depth[slot[i]];
+    depth[slot[i]] = d;
+    for (std::size_t j = inner[s]; j != i; j = parent[j]) {
+      depth[slot[j]] = d + steps--;
+    }
+  }
+  std::pmr::vector<std::size_t> by_depth(inner.size(), mem);
+  std::iota(by_depth.begin(), by_depth.end(), 0);
+  std::ranges::stable_sort(by_depth, _gt_,
+                           [&depth](std::size_t s) { return depth[s]; });
+
+  const GroupIndex groups = make_group_index(polys, indices, false, mem);
+  // Of the inner groups, the compound and where their parent's cloud moved it
+  std::pmr::vector<std::optional<PolygonE>> compounds(inner.size(), mem);
+  std::pmr::vector<Point> deltas(inner.size(), mem);
+  std::pmr::vector<bool> in_parent(inner.size(), false, mem);
+  // Of every polygon, within the cloud of its own group
+  std::pmr::vector<bool> placed_within(n, false, mem);
+  std::size_t probes = 0;
+
+  // Polygons of a cloud and their indices, the groups first. Inner groups
+  // among the children stand in by their compound, and are left out if it is
+  // empty. Every polygon is added once
+  struct Members {
+    explicit Members(std::pmr::memory_resource *mem) : polys{mem}, ids{mem} {}
+    std::pmr::vector<const PolygonE *> polys;
+    std::pmr::vector<std::size_t> ids;
+  };
+  std::pmr::vector<std::size_t> added_to(n, no_parent, mem);
+  std::size_t n_clouds = 0;
+  // Sub-clouds placed on several threads allocate from `mem` through it
+  std::pmr::synchronized_pool_resource shared{mem};
+  auto add = [&](Members &m, std::size_t i, bool as_group) {
+    if (added_to[i] == n_clouds) {
+      return;
+    }
+    if (as_group || not is_inner(i)) {
+      m.polys.push_back(&polys[i]);
+    } else if (compounds[slot[i]]) {
+      m.polys.push_back(&*compounds[slot[i]]);
+    } else {
+      return;
+    }
+    added_to[i] = n_clouds;
+    m.ids.push_back(i);
+  };
+  // Takes back the polygons of a cloud placed as `placed`. The first one is
+  // the group itself in the cloud of an inner group
+  auto take_back = [&](const Members &m, std::span<const PolygonE> placed,
+                       const Cloud &cloud, bool of_inner) {
+    for (std::size_t k = 0; k < m.ids.size(); ++k) {
+      const std::size_t i = m.ids[k];
+      if (is_inner(i) && not(of_inner && k == 0)) {
+        const std::size_t s = slot[i];
+        deltas[s] = placed[k].rects.front().tl() -
+                    compounds[s]->rects.front().tl();
+        in_parent[s] = cloud.placed[k];
+      } else {
+        polys[i] = placed[k];
+        placed_within[i] = cloud.placed[k];
+      }
+    }
+    probes += cloud.probes;
+  };
+
+  for (std::size_t begin = 0, end = 0; begin < by_depth.size(); begin = end) {
+    while (end < by_depth.size() &&
+           depth[by_depth[end]] == depth[by_depth[begin]]) {
+      ++end;
+    }
+    const auto level = std::span{by_depth}.subspan(begin, end - begin);
+    std::pmr::vector<Members> members(mem);
+    members.reserve(level.size());
+    for (const std::size_t s : level) {
+      Members &m = members.emplace_back(mem);
+      add(m, inner[s], true);
+      for (const std::size_t child : groups.group(inner[s])) {
+        add(m, child, false);
+      }
+      ++n_clouds;
+    }
+    const std::size_t threads =
+        hierarchy::thread_count(opts.threads, level.size());
+    std::pmr::memory_resource *upstream = threads > 1 ? &shared : mem;
+    std::pmr::vector<std::optional<hierarchy::SubCloud>> subs(level.size(),
+                                                              mem);
+    hierarchy::for_each_parallel(
+        level.size(), threads, [&](std::size_t k, std::size_t) {
+          hierarchy::place_sub_cloud(subs[k].emplace(upstream),
+                                     members[k].polys, opts);
+        });
+    Bounds rects(mem);
+    for (std::size_t k = 0; k < level.size(); ++k) {
+      const hierarchy::SubCloud &sub = *subs[k];
+      take_back(members[k], sub.polys, *sub.cloud, true);
+      rects.clear();
+      for (std::size_t j = 0; j < sub.polys.size(); ++j) {
+        if (sub.cloud->placed[j]) {
+          rects.insert(rects.end(), sub.polys[j].rects.begin(),
+                       sub.polys[j].rects.end());
+        }
+      }
+      if (not rects.empty()) {
+        PolygonE &compound = compounds[level[k]].emplace(
+            Polygon{hierarchy::column_hull(rects, mem)});
+        compound.compound = true;
+      }
+    }
+  }
+
+  // The outermost cloud, of the groups that have no parent and their children
+  Members top{mem};
+  for (std::size_t i = 0; i < n; ++i) {
+    if (parent[i] == no_parent && has_children[i]) {
+      add(top, i, true);
+    }
+  }
+  std::pmr::vector<std::size_t> local(n, no_parent, mem);
+  for (std::size_t k = 0; k < top.ids.size(); ++k) {
+    local[top.ids[k]] = k;
+  }
+  std::pmr::vector<IndexPair> pairs(mem);
+  for (const auto [src, dst] : indices) {
+    if (parent[src] != no_parent) {
+      continue;
+    }
+    if (local[dst] == no_parent) {
+      add(top, dst, false);
+      if (added_to[dst] != n_clouds) {
+        continue;
+      }
+      local[dst] = top.ids.size() - 1;
+    }
+    pairs.push_back({.src = local[src], .dst = local[dst]});
+  }
+  std::pmr::vector<PolygonE> top_polys(mem);
+  top_polys.reserve(top.polys.size());
+  for (const PolygonE *p : top.polys) {
+    top_polys.push_back(hierarchy::copy_polygon(*p, mem));
+  }
+  Cloud result = make_cloud(top_polys, pairs, board_dims, opts, mem);
+  take_back(top, top_polys, result, false);
+
+  // Inner groups are moved by the compounds around them, outside in
+  std::pmr::vector<Point> shifts(inner.size(), mem);
+  std::pmr::vector<bool> kept(inner.size(), false, mem);
+  for (auto it = by_depth.rbegin(); it != by_depth.rend(); ++it) {
+    const std::size_t s = *it;
+    const std::size_t up = parent[inner[s]];
+    const bool nested = is_inner(up);
+    shifts[s] = deltas[s] + (nested ? shifts[slot[up]] : Point{});
+    kept[s] = in_parent[s] && (not nested || kept[slot[up]]);
+  }
+  result.placed.assign(n, false);
+  result.number_placed = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    const std::size_t group = is_inner(i) ? i : parent[i];
+    bool placed = placed_within[i];
+    if (is_inner(group)) {
+      polys[i].move_by(shifts[slot[group]]);
+      placed = placed && kept[slot[group]];
+    }
+    result.placed[i] = placed;
+    result.number_placed += placed ? 1 : 0;
+  }
+  result.probes = probes;
+  return result;
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+#include "api.h"
+#include "rect.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary placement jobs and their results, as read and written by rp_cli. All
+// values are in the byte order of the host.
+//
+// A job is a JobHeader followed by its arrays, each starting on 8 bytes:
+//
+//   Rect          rects[n_rects]            lft top rgt bot, as floats
+//   std::uint64_t offsets[n_polygons + 1]   as in PlaceJob
+//   std::uint64_t indices[2 * n_indices]    src dst
+//   float         tolerances[n_polygons]
+//
+// so that on 64 bit hosts a job is placed straight out of the bytes it was
+// read into, or out of a mapped file. A job file is a FileHeader, the offsets
+// of its jobs from the start of the file, and the jobs. A result file is a
+// FileHeader with `result_magic`, followed by a RecordHeader and the positions
+// of every job, in the order the jobs were finished in
+namespace job_file {
+
+constexpr std::array<char, 8> job_magic{'R', 'P', 'J', 'O', 'B', 'S', 0, 0};
+constexpr std::array<char, 8> result_magic{'R', 'P', 'R', 'E',
+                                           'S', 'U', 'L', 'T'};
+constexpr std::uint32_t version = 1;
+
+struct FileHeader {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t reserved;
+  std::uint64_t n_jobs;
+};
+
+struct JobHeader {
+  std::uint64_t n_rects;
+  std::uint64_t n_polygons;
+  std::uint64_t n_indices;
+  float board_w;
+  float board_h;
+};
+
+struct RecordHeader {
+  std::uint64_t job;
+  std::int32_t number_placed; // -1 if the job was rejected
+  std::uint32_t n_positions;  // 0 if the job was rejected
+  double ms;                  // Spent placing it
+};
+
+static_assert(sizeof(Rect) == 4 * sizeof(float));
+static_assert(sizeof(JobHeader) % 8 == 0 && sizeof(RecordHeader) % 8 == 0);
+
+constexpr auto padded(std::size_t n) -> std::size_t {
+  return (n + 7) & ~std::size_t{7};
+}
+
+// Bytes of `job` once encoded
+inline auto encoded_size(const PlaceJob &job) -> std::size_t {
+  return sizeof(JobHeader) + padded(job.rects.size_bytes()) +
+         8 * job.offsets.size() + 16 * job.indices.size() +
+         padded(job.tolerances.size_bytes());
+}
+
+// Appends `job` to `out`
+inline void encode(const PlaceJob &job, std::vector<std::byte> &out) {
+  const std::size_t start = out.size();
+  out.resize(start + encoded_size(job));
+  std::byte *at = out.data() + start;
+  auto put = [&at](const void *data, std::size_t n) {
+    std::memcpy(at, data, n);
+    at += padded(n);
+  };
+  const JobHeader header{
+      .n_rects = job.rects.size(),
+      .n_polygons = job.size(),
+      .n_indices = job.indices.size(),
+      .board_w = job.board_dims.x,
+      .board_h = job.board_dims.y,
+  };
+  put(&header, sizeof(header));
+  put(job.rects.data(), job.rects.size_bytes());
+  for (const std::uint64_t offset : job.offsets) {
+    put(&offset, sizeof(offset));
+  }
+  for (const auto [src, dst] : job.indices) {
+    const std::array<std::uint64_t, 2> pair{src, dst};
+    put(pair.data(), sizeof(pair));
+  }
+  put(job.tolerances.data(), job.tolerances.size_bytes());
+}
+
+// The job at the start of `bytes`, which have to be aligned to 8. None if they
+// are too short for it. Its spans point into `bytes`, unless the host's
+// std::size_t is narrower than 64 bits: offsets and indices are then copied
+// into buffers allocated from `mem`. The job is not validated, see `validate`
+inline auto decode(std::span<const std::byte> bytes,
+                   std::pmr::memory_resource *mem =
+                       std::pmr::get_default_resource())
+    -> std::optional<PlaceJob> {
+  CUSTOM_ASSERT(reinterpret_cast<std::uintptr_t>(bytes.data()) % 8 == 0);
+  std::size_t at = 0;
+  // Start of `count` items of `size` bytes, if they fit
+  auto take = [&](std::uint64_t count,
+                  std::size_t size) -> const std::byte * {
+    if (at > bytes.size() || count > (bytes.size() - at) / size ||
+        padded(count * size) > bytes.size() - at) {
+      return nullptr;
+    }
+    const std::byte *result = bytes.data() + at;
+    at += padded(count * size);
+    return result;
+  };
+  const auto *header =
+      reinterpret_cast<const JobHeader *>(take(1, sizeof(JobHeader)));
+  if (header == nullptr ||
+      header->n_polygons == std::numeric_limits<std::uint64_t>::max()) {
+    return std::nullopt;
+  }
+  const auto *rects = take(header->n_rects, sizeof(Rect));
+  const auto *offsets = take(header->n_polygons + 1, 8);
+  const auto *indices = take(header->n_indices, 16);
+  const auto *tolerances = take(header->n_polygons, sizeof(float));
+  if (rects == nullptr || offsets == nullptr || indices == nullptr ||
+      tolerances == nullptr) {
+    return std::nullopt;
+  }
+  // Each of them fits in the bytes, so in a std::size_t
+  const auto n_rects = static_cast<std::size_t>(header->n_rects);
+  const auto n_polygons = static_cast<std::size_t>(header->n_polygons);
+  const auto n_indices = static_cast<std::size_t>(header->n_indices);
+  PlaceJob job{
+      .rects = {reinterpret_cast<const Rect *>(rects), n_rects},
+      .offsets = {},
+      .indices = {},
+      .tolerances = {reinterpret_cast<const float *>(tolerances), n_polygons},
+      .board_dims = {header->board_w, header->board_h},
+  };
+  if constexpr (sizeof(std::size_t) == sizeof(std::uint64_t)) {
+    job.offsets = {reinterpret_cast<const std::size_t *>(offsets),
+                   n_polygons + 1};
+    job.indices = {reinterpret_cast<const IndexPair *>(indices), n_indices};
+  } else {
+    const auto *wide = reinterpret_cast<const std::uint64_t *>(offsets);
+    auto *narrow = static_cast<std::size_t *>(mem->allocate(
+        (n_polygons + 1) * sizeof(std::size_t), alignof(std::size_t)));
+    for (std::size_t i = 0; i <= n_polygons; ++i) {
+      narrow[i] = static_cast<std::size_t>(wide[i]);
+    }
+    job.offsets = {narrow, n_polygons + 1};
+    wide = reinterpret_cast<const std::uint64_t *>(indices);
+    auto *pairs = static_cast<IndexPair *>(
+        mem->allocate(n_indices * sizeof(IndexPair), alignof(IndexPair)));
+    for (std::size_t i = 0; i < n_indices; ++i) {
+      pairs[i] = {static_cast<std::size_t>(wide[2 * i]),
+                  static_cast<std::size_t>(wide[2 * i + 1])};
+    }
+    job.indices = {pairs, n_indices};
+  }
+  return job;
+}
+
+// False if `path` can not be written
+inline auto write(const char *path, std::span<const PlaceJob> jobs) -> bool {
+  const FileHeader header{job_magic, version, 0, jobs.size()};
+  std::vector<std::byte> bytes(sizeof(header) + padded(8 * jobs.size()));
+  std::memcpy(bytes.data(), &header, sizeof(header));
+  for (std::size_t i = 0; i < jobs.size(); ++i) {
+    const std::uint64_t offset = bytes.size();
+    std::memcpy(bytes.data() + sizeof(header) + 8 * i, &offset, 8);
+    encode(jobs[i], bytes);
+  }
+  std::FILE *file = std::fopen(path, "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  const bool written =
+      std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  return std::fclose(file) == 0 && written;
+}
+
+// A job file mapped into memory, read only
+class Mapped {
+public:
+  Mapped() = default;
+  Mapped(const Mapped &) = delete;
+  auto operator=(const Mapped &) -> Mapped & = delete;
+  ~Mapped() { close(); }
+
+  // False if `path` can not be mapped, or is not a job file of this version
+  auto open(const char *path) -> bool {
+    close();
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      size_ = static_cast<std::size_t>(st.st_size);
+      void *data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      data_ = data == MAP_FAILED ? nullptr : static_cast<std::byte *>(data);
+    }
+    ::close(fd); // The mapping stays
+    FileHeader header{};
+    if (data_ == nullptr || size_ < sizeof(header)) {
+      close();
+      return false;
+    }
+    std::memcpy(&header, data_, sizeof(header));
+    if (header.magic != job_magic || header.version != version ||
+        header.n_jobs > (size_ - sizeof(header)) / 8) {
+      close();
+      return false;
+    }
+    ::madvise(data_, size_, MADV_SEQUENTIAL);
+    n_jobs_ = header.n_jobs;
+    return true;
+  }
+
+  void close() {
+    if (data_ != nullptr) {
+      ::munmap(data_, size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    n_jobs_ = 0;
+  }
+
+  auto size() const -> std::size_t { return n_jobs_; }
+
+  // Job `i`, none if its offset is out of the file or not aligned, or it does
+  // not fit before the next job. See `decode`
+  auto job(std::size_t i, std::pmr::memory_resource *mem =
+                              std::pmr::get_default_resource()) const
+      -> std::optional<PlaceJob> {
+    CUSTOM_ASSERT(i < n_jobs_);
+    const std::uint64_t begin = offset(i);
+    const std::uint64_t end = i + 1 < n_jobs_ ? offset(i + 1) : size_;
+    if (begin % 8 != 0 || begin > end || end > size_) {
+      return std::nullopt;
+    }
+    return decode(std::span{data_ + begin, data_ + end}, mem);
+  }
+
+private:
+  auto offset(std::size_t i) const -> std::uint64_t {
+    std::uint64_t result;
+    std::memcpy(&result, data_ + sizeof(FileHeader) + 8 * i, 8);
+    return result;
+  }
+
+  std::byte *data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t n_jobs_ = 0;
+};
+
+// Appends records to a result file. Not synchronized
+class ResultWriter {
+public:
+  ResultWriter() = default;
+  ResultWriter(const ResultWriter &) = delete;
+  auto operator=(const ResultWriter &) -> ResultWriter & = delete;
+  ~ResultWriter() { close(); }
+
+  // Truncates `path`. False if it can not be written
+  auto open(const char *path, std::size_t n_jobs) -> bool {
+    close();
+    file_ = std::fopen(path, "wb");
+    const FileHeader header{result_magic, version, 0, n_jobs};
+    return file_ != nullptr &&
+           std::fwrite(&header, sizeof(header), 1, file_) == 1;
+  }
+
+  // False once a write failed
+  auto write(const RecordHeader &record, std::span<const Point> positions)
+      -> bool {
+    CUSTOM_ASSERT(record.n_positions == positions.size());
+    return file_ != nullptr &&
+           std::fwrite(&record, sizeof(record), 1, file_) == 1 &&
+           (positions.empty() ||
+            std::fwrite(positions.data(), sizeof(Point), positions.size(),
+                        file_) == positions.size());
+  }
+
+  // False if buffered records could not be written
+  auto close() -> bool {
+    const bool ok = file_ == nullptr || std::fclose(file_) == 0;
+    file_ = nullptr;
+    return ok;
+  }
+
+private:
+  std::FILE *file_ = nullptr;
+};
+
+struct Result {
+  RecordHeader record;
+  std::vector<Point> positions;
+};
+
+// Records of the result file at `path`, none if it can not be read
+inline auto read_results(const char *path)
+    -> std::optional<std::vector<Result>> {
+  std::FILE *file = std::fopen(path, "rb");
+  if (file == nullptr) {
+    return std::nullopt;
+  }
+  FileHeader header{};
+  std::optional<std::vector<Result>> results;
+  if (std::fread(&header, sizeof(header), 1, file) == 1 &&
+      header.magic == result_magic && header.version == version) {
+    results.emplace();
+    Result r{};
+    while (std::fread(&r.record, sizeof(r.record), 1, file) == 1) {
+      r.positions.resize(r.record.n_positions);
+      if (not r.positions.empty() &&
+          std::fread(r.positions.data(), sizeof(Point), r.positions.size(),
+                     file) != r.positions.size()) {
+        break; // Cut short
+      }
+      results->push_back(r);
+    }
+  }
+  std::fclose(file);
+  return results;
+}
+
+} // namespace job_file
@@ -0,0 +1,391 @@
+#pragma once
+
+#include "api.h"
+#include "cloud.h"
+#include "rect.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bump with every change to the layout placed for any job, whether or not
+// exec/rp_regress.baseline has to be rewritten for it. It is part of every
+// key, so layouts of an older engine are never returned. 2: nested groups are
+// placed as sub-clouds
+constexpr std::uint32_t layout_version = 2;
+
+namespace layout_cache {
+
+// Everything that decides a layout as 32 bit words in `bytes`, and their
+// FNV-1a `hash`. Layouts are looked up by hash, and only returned if their
+// bytes are equal as well, so that a collision is a miss
+struct Key {
+  std::uint64_t hash = 0xcbf29ce484222325;
+  std::vector<std::byte> bytes;
+
+  void add(std::uint32_t word) {
+    hash = (hash ^ word) * 0x100000001b3;
+    const auto *at = reinterpret_cast<const std::byte *>(&word);
+    bytes.insert(bytes.end(), at, at + sizeof(word));
+  }
+  void add(std::uint64_t word) {
+    add(static_cast<std::uint32_t>(word));
+    add(static_cast<std::uint32_t>(word >> 32));
+  }
+  // -0 and 0 place the same
+  void add(float f) { add(std::bit_cast<std::uint32_t>(f == 0.F ? 0.F : f)); }
+
+  auto matches(std::span<const std::byte> other) const -> bool {
+    return std::ranges::equal(bytes, other);
+  }
+};
+
+// Key of everything that decides the layout of `job`: the engine version,
+// the job and the options that move polygons. Sizes come before the arrays,
+// so that different splits of the same values differ. A compaction time
+// limit is part of it as well, the first layout placed with it is kept.
+// CloudOptions::bvh_min_rects does not change layouts and is left out
+inline auto job_key(const PlaceJob &job, const CloudOptions &opts) -> Key {
+  Key h;
+  h.add(layout_version);
+  h.add(std::uint64_t{job.rects.size()});
+  for (const Rect &r : job.rects) {
+    h.add(r.lft);
+    h.add(r.top);
+    h.add(r.rgt);
+    h.add(r.bot);
+  }
+  h.add(std::uint64_t{job.offsets.size()});
+  for (const std::size_t offset : job.offsets) {
+    h.add(std::uint64_t{offset});
+  }
+  h.add(std::uint64_t{job.indices.size()});
+  for (const auto [src, dst] : job.indices) {
+    h.add(std::uint64_t{src});
+    h.add(std::uint64_t{dst});
+  }
+  h.add(std::uint64_t{job.tolerances.size()});
+  for (const float tolerance : job.tolerances) {
+    h.add(tolerance);
+  }
+  h.add(job.board_dims.x);
+  h.add(job.board_dims.y);
+  h.add(std::uint32_t{opts.sort_children_by_area});
+  h.add(static_cast<std::uint32_t>(opts.coordinates));
+  h.add(static_cast<std::uint32_t>(opts.engine));
+  h.add(static_cast<std::uint32_t>(opts.index));
+  h.add(std::uint64_t{opts.max_growths});
+  h.add(opts.max_growths == 0 ? 0.F : opts.growth_factor);
+  h.add(std::uint64_t{opts.compaction_rounds});
+  h.add(std::bit_cast<std::uint64_t>(
+      opts.compaction_rounds == 0 ? 0. : opts.compaction_ms));
+  return h;
+}
+
+struct Layout {
+  int number_placed = 0;
+  std::vector<Point> positions;
+};
+
+// The `capacity` most recently used layouts. Of keys with the same hash,
+// only the last inserted is kept
+class Lru {
+public:
+  explicit Lru(std::size_t capacity) : capacity_{capacity} {}
+
+  // Moves a hit to the front
+  auto find(const Key &key) -> const Layout * {
+    const auto it = index_.find(key.hash);
+    if (it == index_.end() || not key.matches(it->second->first.bytes)) {
+      return nullptr;
+    }
+    items_.splice(items_.begin(), items_, it->second);
+    return &it->second->second;
+  }
+
+  void insert(Key key, Layout layout) {
+    if (capacity_ == 0) {
+      return;
+    }
+    if (const auto it = index_.find(key.hash); it != index_.end()) {
+      *it->second = {std::move(key), std::move(layout)};
+      items_.splice(items_.begin(), items_, it->second);
+      return;
+    }
+    if (items_.size() == capacity_) {
+      index_.erase(items_.back().first.hash);
+      items_.pop_back();
+    }
+    const std::uint64_t hash = key.hash;
+    items_.emplace_front(std::move(key), std::move(layout));
+    index_.emplace(hash, items_.begin());
+  }
+
+  auto size() const -> std::size_t { return items_.size(); }
+
+private:
+  std::size_t capacity_;
+  std::list<std::pair<Key, Layout>> items_;
+  std::unordered_map<std::uint64_t, decltype(items_)::iterator> index_;
+};
+
+// Append only file of layouts, mapped into memory. After a header of `magic`,
+// layout_version and `format`, every record is a RecordHeader followed by the
+// bytes of its key and its positions. A record cut short, by a crash in the
+// middle of an append, is dropped on open, as are all records of another
+// version or format. Of records with the same key hash, the last one is kept.
+// The file is locked, so only one process uses it at a time
+class File {
+public:
+  constexpr static std::array<char, 8> magic{'R', 'P', 'L', 'A',
+                                             'Y', 'O', 'U', 'T'};
+  // 1: records hold the bytes of their key
+  constexpr static std::uint32_t format = 1;
+  struct Header {
+    std::array<char, 8> magic;
+    std::uint32_t version;
+    std::uint32_t format;
+  };
+  struct RecordHeader {
+    std::uint64_t key; // Hash
+    std::uint32_t n_positions;
+    std::int32_t number_placed;
+    std::uint64_t n_key_bytes;
+  };
+
+  File() = default;
+  File(const File &) = delete;
+  auto operator=(const File &) -> File & = delete;
+  ~File() { close(); }
+
+  // False if `path` can not be opened, mapped or locked
+  auto open(const char *path) -> bool {
+    close();
+    fd_ = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+      return false;
+    }
+    if (::flock(fd_, LOCK_EX | LOCK_NB) != 0 || not map()) {
+      close();
+      return false;
+    }
+    Header header{};
+    if (size_ >= sizeof(Header)) {
+      std::memcpy(&header, data_, sizeof(Header));
+    }
+    if (header.magic != magic || header.version != layout_version ||
+        header.format != format) {
+      header = {magic, layout_version, format};
+      if (not truncate(0) || not write(&header, sizeof(header))) {
+        close();
+        return false;
+      }
+      return true;
+    }
+    std::size_t at = sizeof(Header);
+    while (at + sizeof(RecordHeader) <= size_) {
+      RecordHeader record;
+      std::memcpy(&record, data_ + at, sizeof(record));
+      if (record.n_key_bytes > size_) {
+        break;
+      }
+      const std::size_t end = at + sizeof(record) + record.n_key_bytes +
+                              record.n_positions * sizeof(Point);
+      if (end > size_) {
+        break;
+      }
+      index_[record.key] = at;
+      at = end;
+    }
+    if (at < size_ && not truncate(at)) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (data_ != nullptr) {
+      ::munmap(data_, size_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_); // Also releases the lock
+    }
+    fd_ = -1;
+    data_ = nullptr;
+    size_ = 0;
+    index_.clear();
+  }
+
+  auto is_open() const -> bool { return fd_ >= 0; }
+  auto size() const -> std::size_t { return index_.size(); }
+
+  // Copies the layout of `key` into `out`, if it has as many positions
+  auto find(const Key &key, std::span<Point> out) const
+      -> std::optional<int> {
+    const auto it = index_.find(key.hash);
+    if (it == index_.end() || not matches(it->second, key)) {
+      return std::nullopt;
+    }
+    RecordHeader record;
+    std::memcpy(&record, data_ + it->second, sizeof(record));
+    if (record.n_positions != out.size()) {
+      return std::nullopt;
+    }
+    std::memcpy(out.data(),
+                data_ + it->second + sizeof(record) + record.n_key_bytes,
+                out.size_bytes());
+    return record.number_placed;
+  }
+
+  // False if the file could not be extended, it is then closed
+  auto insert(const Key &key, int number_placed,
+              std::span<const Point> positions) -> bool {
+    if (const auto it = index_.find(key.hash);
+        it != index_.end() && matches(it->second, key)) {
+      return true;
+    }
+    const std::size_t at = size_;
+    const RecordHeader record{key.hash,
+                              static_cast<std::uint32_t>(positions.size()),
+                              number_placed, key.bytes.size()};
+    std::vector<std::byte> bytes(sizeof(record) + key.bytes.size() +
+                                 positions.size_bytes());
+    std::memcpy(bytes.data(), &record, sizeof(record));
+    std::ranges::copy(key.bytes, bytes.begin() + sizeof(record));
+    std::memcpy(bytes.data() + sizeof(record) + key.bytes.size(),
+                positions.data(), positions.size_bytes());
+    if (not write(bytes.data(), bytes.size())) {
+      close();
+      return false;
+    }
+    index_[key.hash] = at;
+    return true;
+  }
+
+private:
+  auto matches(std::size_t at, const Key &key) const -> bool {
+    RecordHeader record;
+    std::memcpy(&record, data_ + at, sizeof(record));
+    return key.matches(
+        {data_ + at + sizeof(record), static_cast<std::size_t>(
+                                          record.n_key_bytes)});
+  }
+
+  // Appends at the end of the file and maps it again
+  auto write(const void *bytes, std::size_t n) -> bool {
+    const auto at = static_cast<off_t>(size_);
+    return ::pwrite(fd_, bytes, n, at) == static_cast<ssize_t>(n) && map();
+  }
+
+  auto truncate(std::size_t size) -> bool {
+    return ::ftruncate(fd_, static_cast<off_t>(size)) == 0 && map();
+  }
+
+  auto map() -> bool {
+    if (data_ != nullptr) {
+      ::munmap(data_, size_);
+      data_ = nullptr;
+    }
+    struct stat st {};
+    if (::fstat(fd_, &st) != 0) {
+      return false;
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ == 0) {
+      return true;
+    }
+    void *data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      size_ = 0;
+      return false;
+    }
+    data_ = static_cast<std::byte *>(data);
+    return true;
+  }
+
+  int fd_ = -1;
+  std::byte *data_ = nullptr;
+  std::size_t size_ = 0;
+  // Record offsets by key hash
+  std::unordered_map<std::uint64_t, std::size_t> index_;
+};
+
+} // namespace layout_cache
+
+// Returns the layout of a job seen before without placing it again. Layouts
+// are looked up by layout_cache::job_key, which holds the whole job, first
+// among the `capacity` most recently used ones in memory, then in the file
+// given to `open`, if any. Misses are placed and stored in both
+class LayoutCache {
+public:
+  explicit LayoutCache(std::size_t capacity = 256) : lru_{capacity} {}
+
+  // Keeps layouts in `path` as well, see layout_cache::File. False if it can
+  // not be used, the cache then stays in memory only
+  auto open(const char *path) -> bool { return file_.open(path); }
+
+  // Like `place`. On a hit `stats` is cleared, as nothing was placed. Layouts
+  // only keep positions, so CloudOptions::rotate is not cached
+  auto place(const PlaceJob &job, std::span<Point> out,
+             const CloudOptions &opts = {},
+             std::pmr::memory_resource *mem = std::pmr::get_default_resource(),
+             CloudStats *stats = nullptr) -> int {
+    CUSTOM_ASSERT(not opts.rotate);
+    layout_cache::Key key = layout_cache::job_key(job, opts);
+    if (const layout_cache::Layout *layout = lru_.find(key);
+        layout != nullptr && layout->positions.size() == out.size()) {
+      std::ranges::copy(layout->positions, out.begin());
+      return hit(stats, layout->number_placed);
+    }
+    if (file_.is_open()) {
+      if (const auto placed = file_.find(key, out)) {
+        lru_.insert(std::move(key), {*placed, {out.begin(), out.end()}});
+        return hit(stats, *placed);
+      }
+    }
+    ++misses_;
+    const int placed = ::place(job, out, opts, mem, stats);
+    if (file_.is_open()) {
+      file_.insert(key, placed, out);
+    }
+    lru_.insert(std::move(key), {placed, {out.begin(), out.end()}});
+    return placed;
+  }
+
+  auto hits() const -> std::size_t { return hits_; }
+  auto misses() const -> std::size_t { return misses_; }
+  auto lru() const -> const layout_cache::Lru & { return lru_; }
+  auto file() const -> const layout_cache::File & { return file_; }
+
+private:
+  auto hit(CloudStats *stats, int placed) -> int {
+    ++hits_;
+    if (stats != nullptr) {
+      *stats = {};
+    }
+    return placed;
+  }
+
+  layout_cache::Lru lru_;
+  layout_cache::File file_;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+};
@@ -0,0 +1,598 @@
+#pragma once
+
+#include "api.h"
+#include "hierarchy.h"
+#include "job_file.h"
+#include "rect.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Placement as a local service on a Unix domain socket, see rp_server. Every
+// message, either way, is a frame: its size in bytes as a std::uint32_t, then
+// a MessageHeader and its body, in the byte order of the host:
+//
+//   PLACE request   a job as job_file::encode writes it
+//   PLACE response  a job_file::RecordHeader, whose `job` is the id of the
+//                   request, then the positions, or the error message if
+//                   `number_placed` is -1
+//   STATS request   nothing
+//   STATS response  a ServerStats
+//
+// A connection may send requests without waiting for the answers, which come
+// back as they are done, not in order
+namespace placement_server {
+
+enum Kind : std::uint32_t { PLACE = 1, STATS = 2 };
+
+// CloudOptions of a PLACE request
+enum Flags : std::uint32_t {
+  INT_COORDINATES = 1, // Coordinates::Int32
+  FRONTIER = 2,        // Engine::Frontier
+  POLAR = 4,           // CollisionIndex::Polar
+};
+
+struct MessageHeader {
+  std::uint32_t kind;
+  std::uint32_t flags; // Of a PLACE request
+  std::uint64_t id;    // Chosen by the client, answered with
+};
+
+// Latencies are of the last `latency_window` answers
+struct ServerStats {
+  std::uint64_t requests;     // Answered
+  std::uint64_t failed;       // Answered with an error
+  std::uint64_t queue_depth;  // Received and waiting for a worker
+  std::uint64_t max_queue_depth;
+  std::uint64_t workers;
+  std::uint64_t connections; // Open
+  double queue_ms_p50;       // From received to taken by a worker
+  double queue_ms_p99;
+  double latency_ms_p50; // From received to answered
+  double latency_ms_p99;
+  double latency_ms_max;
+};
+
+constexpr std::size_t latency_window = 4096;
+// Frames larger than this close the connection
+constexpr std::uint32_t max_frame = 1U << 30;
+
+static_assert(sizeof(MessageHeader) % 8 == 0);
+
+inline auto options(std::uint32_t flags) -> CloudOptions {
+  return {
+      .coordinates = (flags & INT_COORDINATES) != 0 ? Coordinates::Int32
+                                                     : Coordinates::Float,
+      .engine = (flags & FRONTIER) != 0 ? Engine::Frontier : Engine::Spiral,
+      .index = (flags & POLAR) != 0 ? CollisionIndex::Polar
+                                    : CollisionIndex::Quadtree,
+      // Requests already run in parallel, their nested groups do not
+      .threads = 1,
+  };
+}
+
+// False once the socket is closed or fails
+inline auto send_all(int fd, const void *data, std::size_t n) -> bool {
+  const auto *at = static_cast<const std::byte *>(data);
+  while (n > 0) {
+    const ssize_t sent = ::send(fd, at, n, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    at += sent;
+    n -= static_cast<std::size_t>(sent);
+  }
+  return true;
+}
+
+inline auto receive_all(int fd, void *data, std::size_t n) -> bool {
+  auto *at = static_cast<std::byte *>(data);
+  while (n > 0) {
+    const ssize_t received = ::recv(fd, at, n, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    at += received;
+    n -= static_cast<std::size_t>(received);
+  }
+  return true;
+}
+
+// Sends a frame of `header` and `body`, each of its parts in turn
+inline auto send_frame(int fd, const MessageHeader &header,
+                       std::initializer_list<std::span<const std::byte>> body)
+    -> bool {
+  std::size_t size = sizeof(header);
+  for (const auto part : body) {
+    size += part.size();
+  }
+  if (size > max_frame) {
+    return false;
+  }
+  const auto size32 = static_cast<std::uint32_t>(size);
+  if (not send_all(fd, &size32, sizeof(size32)) ||
+      not send_all(fd, &header, sizeof(header))) {
+    return false;
+  }
+  return std::ranges::all_of(body, [fd](std::span<const std::byte> part) {
+    return part.empty() || send_all(fd, part.data(), part.size());
+  });
+}
+
+// The size of the next frame. None once the socket is closed, or if the frame
+// is smaller than a MessageHeader or larger than `limit`
+inline auto receive_size(int fd, std::size_t limit = max_frame)
+    -> std::optional<std::uint32_t> {
+  std::uint32_t size = 0;
+  if (not receive_all(fd, &size, sizeof(size)) ||
+      size < sizeof(MessageHeader) || size > limit) {
+    return std::nullopt;
+  }
+  return size;
+}
+
+// The next frame, MessageHeader included, into `out`. False once the socket
+// is closed, or the frame is too small or too large
+inline auto receive_frame(int fd, std::vector<std::byte> &out) -> bool {
+  const std::optional<std::uint32_t> size = receive_size(fd);
+  if (not size) {
+    return false;
+  }
+  out.resize(*size);
+  return receive_all(fd, out.data(), *size);
+}
+
+inline auto header_of(std::span<const std::byte> frame) -> MessageHeader {
+  MessageHeader result;
+  std::memcpy(&result, frame.data(), sizeof(result));
+  return result;
+}
+
+// Answers the requests of every connection on a pool of worker threads. Each
+// connection has a thread of its own that reads its requests into a queue of
+// at most `max_queue` of them, where they wait for the next free worker. A
+// worker keeps a memory pool from request to request, and places each one out
+// of an arena on it.
+//
+// Requests larger than `max_request` bytes close their connection. Room for a
+// request is taken before it is read and given back once it is answered, and
+// requests being read, queued or placed take at most `max_queue_bytes`
+// between them, so that a few large ones wait instead of piling up
+class Server {
+public:
+  // `threads` 0 for one worker per core
+  explicit Server(std::size_t threads = 0, std::size_t max_queue = 1024,
+                  std::size_t max_request = std::size_t{64} << 20,
+                  std::size_t max_queue_bytes = std::size_t{256} << 20)
+      : n_workers_{hierarchy::thread_count(
+            threads, std::numeric_limits<std::size_t>::max())},
+        max_queue_{std::max<std::size_t>(max_queue, 1)},
+        max_request_{std::clamp<std::size_t>(max_request,
+                                             sizeof(MessageHeader), max_frame)},
+        max_queue_bytes_{std::max(max_queue_bytes, max_request_)} {}
+  Server(const Server &) = delete;
+  auto operator=(const Server &) -> Server & = delete;
+  ~Server() {
+    if (listen_fd_ >= 0) {
+      ::close(listen_fd_);
+    }
+  }
+
+  // Replaces what is at `path`. False if the socket can not be bound there
+  auto listen(const char *path) -> bool {
+    sockaddr_un address{.sun_family = AF_UNIX, .sun_path = {}};
+    if (std::strlen(path) >= sizeof(address.sun_path)) {
+      return false;
+    }
+    std::strcpy(address.sun_path, path);
+    ::unlink(path);
+    listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0 ||
+        ::bind(listen_fd_, reinterpret_cast<const sockaddr *>(&address),
+               sizeof(address)) != 0 ||
+        ::listen(listen_fd_, SOMAXCONN) != 0) {
+      return false;
+    }
+    return true;
+  }
+
+  // Serves connections until `stop`. Requests received by then are answered
+  void run() {
+    CUSTOM_ASSERT(listen_fd_ >= 0);
+    std::vector<std::thread> workers;
+    for (std::size_t w = 0; w < n_workers_; ++w) {
+      workers.emplace_back([this] { work(); });
+    }
+    for (;;) {
+      const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
+        break; // Shut down by `stop`
+      }
+      auto connection = std::make_shared<Connection>(fd);
+      {
+        const std::scoped_lock lock{mutex_};
+        if (stopping_) {
+          break;
+        }
+        std::erase_if(connections_, [](const auto &c) { return c.expired(); });
+        connections_.push_back(connection);
+        ++n_readers_;
+      }
+      std::thread{[this, connection] {
+        read(connection);
+        const std::scoped_lock lock{mutex_};
+        --n_readers_;
+        readers_changed_.notify_all();
+      }}.detach();
+    }
+    {
+      std::unique_lock lock{mutex_};
+      stopping_ = true;
+      for (const auto &weak : connections_) {
+        if (const auto connection = weak.lock()) {
+          ::shutdown(connection->fd, SHUT_RD);
+        }
+      }
+      readers_changed_.wait(lock, [this] { return n_readers_ == 0; });
+      drained_ = true;
+    }
+    queue_changed_.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // Makes `run` return. Safe to call from any thread, but not from a signal
+  // handler
+  void stop() {
+    {
+      const std::scoped_lock lock{mutex_};
+      stopping_ = true;
+    }
+    queue_changed_.notify_all();
+    ::shutdown(listen_fd_, SHUT_RDWR);
+  }
+
+  auto stats() const -> ServerStats {
+    const std::scoped_lock lock{mutex_};
+    ServerStats result{
+        .requests = requests_,
+        .failed = failed_,
+        .queue_depth = queue_.size(),
+        .max_queue_depth = max_queue_depth_,
+        .workers = n_workers_,
+        .connections = 0,
+    };
+    for (const auto &weak : connections_) {
+      result.connections += weak.expired() ? 0 : 1;
+    }
+    auto percentile = [](std::vector<double> samples, double p) {
+      if (samples.empty()) {
+        return 0.;
+      }
+      const auto k = static_cast<std::size_t>(p * _float(samples.size() - 1));
+      std::ranges::nth_element(samples, samples.begin() + k);
+      return samples[k];
+    };
+    result.queue_ms_p50 = percentile(queue_ms_, .5);
+    result.queue_ms_p99 = percentile(queue_ms_, .99);
+    result.latency_ms_p50 = percentile(latency_ms_, .5);
+    result.latency_ms_p99 = percentile(latency_ms_, .99);
+    result.latency_ms_max = percentile(latency_ms_, 1.);
+    return result;
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Connection {
+    explicit Connection(int fd) : fd{fd} {}
+    Connection(const Connection &) = delete;
+    auto operator=(const Connection &) -> Connection & = delete;
+    ~Connection() { ::close(fd); }
+
+    // Answers are sent whole, one at a time
+    auto send(const MessageHeader &header,
+              std::initializer_list<std::span<const std::byte>> body)
+        -> bool {
+      const std::scoped_lock lock{send_mutex};
+      return send_frame(fd, header, body);
+    }
+
+    int fd;
+    std::mutex send_mutex;
+  };
+
+  struct Request {
+    std::shared_ptr<Connection> connection;
+    std::vector<std::byte> frame;
+    Clock::time_point received;
+  };
+
+  static auto ms_since(Clock::time_point t) -> double {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+  }
+
+  // Queues the requests of `connection` until it closes, or sends one that is
+  // too large. STATS are answered right away
+  void read(const std::shared_ptr<Connection> &connection) {
+    while (const auto size = receive_size(connection->fd, max_request_)) {
+      {
+        std::unique_lock lock{mutex_};
+        queue_changed_.wait(lock, [this, &size] {
+          return queued_bytes_ + *size <= max_queue_bytes_ || stopping_;
+        });
+        queued_bytes_ += *size;
+      }
+      std::vector<std::byte> frame(*size);
+      if (not receive_all(connection->fd, frame.data(), frame.size())) {
+        release(frame.size());
+        return;
+      }
+      const MessageHeader header = header_of(frame);
+      if (header.kind == STATS) {
+        release(frame.size());
+        const ServerStats s = stats();
+        connection->send(header, {std::as_bytes(std::span{&s, 1})});
+        continue;
+      }
+      std::unique_lock lock{mutex_};
+      queue_changed_.wait(lock, [this] {
+        return queue_.size() < max_queue_ || stopping_;
+      });
+      queue_.push_back({connection, std::move(frame), Clock::now()});
+      max_queue_depth_ = std::max(max_queue_depth_, queue_.size());
+      lock.unlock();
+      queue_changed_.notify_all();
+    }
+  }
+
+  // Gives back the room of a request, see `read`
+  void release(std::size_t size) {
+    {
+      const std::scoped_lock lock{mutex_};
+      queued_bytes_ -= size;
+    }
+    queue_changed_.notify_all();
+  }
+
+  // Answers queued requests until the queue is empty and no more are read
+  void work() {
+    std::pmr::unsynchronized_pool_resource pool;
+    for (;;) {
+      std::unique_lock lock{mutex_};
+      queue_changed_.wait(lock,
+                          [this] { return not queue_.empty() || drained_; });
+      if (queue_.empty()) {
+        return;
+      }
+      Request request = std::move(queue_.front());
+      queue_.pop_front();
+      lock.unlock();
+      queue_changed_.notify_all();
+
+      answer(request, ms_since(request.received), &pool);
+      release(request.frame.size());
+    }
+  }
+
+  void answer(const Request &request, double queue_ms,
+              std::pmr::memory_resource *pool) {
+    std::pmr::monotonic_buffer_resource arena{pool};
+    const auto start = Clock::now();
+    const MessageHeader header = header_of(request.frame);
+    job_file::RecordHeader record{.job = header.id, .number_placed = -1};
+    std::string error;
+    try {
+      const std::optional<PlaceJob> job =
+          header.kind == PLACE
+              ? job_file::decode(
+                    std::span{request.frame}.subspan(sizeof(header)), &arena)
+              : std::nullopt;
+      error = header.kind != PLACE
+                  ? "unknown request kind " + std::to_string(header.kind)
+              : not job ? "job cut short"
+                        : validate(*job, options(header.flags));
+      if (error.empty()) {
+        std::pmr::vector<Point> positions(job->size(), &arena);
+        record.number_placed =
+            place(*job, positions, options(header.flags), &arena);
+        record.n_positions = static_cast<std::uint32_t>(positions.size());
+        record.ms = ms_since(start);
+        count(request, queue_ms, false);
+        request.connection->send(header,
+                                 {std::as_bytes(std::span{&record, 1}),
+                                  std::as_bytes(std::span{positions})});
+        return;
+      }
+    } catch (const std::exception &e) {
+      error = e.what();
+    }
+    record.number_placed = -1;
+    record.n_positions = 0;
+    record.ms = ms_since(start);
+    count(request, queue_ms, true);
+    request.connection->send(header, {std::as_bytes(std::span{&record, 1}),
+                                      std::as_bytes(std::span{error})});
+  }
+
+  // Before the answer is sent, so that its client sees it in the stats
+  void count(const Request &request, double queue_ms, bool failed) {
+    const double latency_ms = ms_since(request.received);
+    const std::scoped_lock lock{mutex_};
+    ++requests_;
+    failed_ += failed ? 1 : 0;
+    add_sample(queue_ms_, queue_ms);
+    add_sample(latency_ms_, latency_ms);
+  }
+
+  void add_sample(std::vector<double> &window, double ms) {
+    if (window.size() < latency_window) {
+      window.push_back(ms);
+    } else {
+      window[requests_ % latency_window] = ms;
+    }
+  }
+
+  const std::size_t n_workers_;
+  const std::size_t max_queue_;
+  const std::size_t max_request_;
+  const std::size_t max_queue_bytes_;
+  int listen_fd_ = -1;
+
+  mutable std::mutex mutex_; // Of everything below
+  std::condition_variable queue_changed_;
+  std::condition_variable readers_changed_;
+  std::deque<Request> queue_;
+  std::size_t queued_bytes_ = 0; // Of requests being read, queued or placed
+  std::vector<std::weak_ptr<Connection>> connections_;
+  std::size_t n_readers_ = 0; // Threads reading a connection
+  bool stopping_ = false;     // No more connections are accepted
+  bool drained_ = false;      // No more requests are read
+  std::uint64_t requests_ = 0;
+  std::uint64_t failed_ = 0;
+  std::size_t max_queue_depth_ = 0;
+  std::vector<double> queue_ms_;
+  std::vector<double> latency_ms_;
+};
+
+struct Response {
+  job_file::RecordHeader record;
+  std::vector<Point> positions;
+  std::string error; // If `record.number_placed` is -1
+};
+
+// Connection to a Server. Not synchronized
+class Client {
+public:
+  Client() = default;
+  Client(const Client &) = delete;
+  auto operator=(const Client &) -> Client & = delete;
+  ~Client() { close(); }
+
+  // False if nothing listens at `path`
+  auto connect(const char *path) -> bool {
+    close();
+    sockaddr_un address{.sun_family = AF_UNIX, .sun_path = {}};
+    if (std::strlen(path) >= sizeof(address.sun_path)) {
+      return false;
+    }
+    std::strcpy(address.sun_path, path);
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 ||
+        ::connect(fd_, reinterpret_cast<const sockaddr *>(&address),
+                  sizeof(address)) != 0) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+    fd_ = -1;
+  }
+
+  // Sends a PLACE request without waiting for its answer, see `receive`.
+  // `flags` are a combination of Flags
+  auto send(const PlaceJob &job, std::uint64_t id, std::uint32_t flags = 0)
+      -> bool {
+    bytes_.clear();
+    job_file::encode(job, bytes_);
+    return send_frame(fd_, {PLACE, flags, id}, {std::span{bytes_}});
+  }
+
+  // The next answer to a PLACE request, none if the connection is closed
+  auto receive() -> std::optional<Response> {
+    constexpr std::size_t min_size =
+        sizeof(MessageHeader) + sizeof(job_file::RecordHeader);
+    if (not receive_frame(fd_, bytes_) || bytes_.size() < min_size) {
+      return std::nullopt;
+    }
+    Response result{};
+    const auto body = std::span{bytes_}.subspan(sizeof(MessageHeader));
+    std::memcpy(&result.record, body.data(), sizeof(result.record));
+    const auto rest = body.subspan(sizeof(result.record));
+    if (result.record.number_placed < 0) {
+      result.error.assign(reinterpret_cast<const char *>(rest.data()),
+                          rest.size());
+      return result;
+    }
+    if (rest.size() != result.record.n_positions * sizeof(Point)) {
+      return std::nullopt;
+    }
+    result.positions.resize(result.record.n_positions);
+    std::memcpy(result.positions.data(), rest.data(), rest.size());
+    return result;
+  }
+
+  // Waits for the answer. The number of polygons placed, -1 if the job was
+  // rejected, with the reason in `error` if given, or the connection failed
+  auto place(const PlaceJob &job, std::span<Point> out, std::uint32_t flags = 0,
+             std::string *error = nullptr) -> int {
+    CUSTOM_ASSERT(out.size() == job.size());
+    std::optional<Response> response;
+    if (send(job, 0, flags)) {
+      response = receive();
+    }
+    if (not response || response->record.number_placed < 0) {
+      if (error != nullptr) {
+        *error = response ? response->error : "connection failed";
+      }
+      return -1;
+    }
+    std::ranges::copy(response->positions, out.begin());
+    return response->record.number_placed;
+  }
+
+  // Asks for the stats of the server. Only to be called with no PLACE
+  // requests waiting for their answers
+  auto stats() -> std::optional<ServerStats> {
+    ServerStats result{};
+    if (not send_frame(fd_, {STATS, 0, 0}, {}) ||
+        not receive_frame(fd_, bytes_) ||
+        bytes_.size() != sizeof(MessageHeader) + sizeof(result)) {
+      return std::nullopt;
+    }
+    std::memcpy(&result, bytes_.data() + sizeof(MessageHeader),
+                sizeof(result));
+    return result;
+  }
+
+private:
+  int fd_ = -1;
+  std::vector<std::byte> bytes_;
+};
+
+} // namespace placement_server
@@ -0,0 +1,300 @@
+#pragma once
+
+#include "defines.h"
+#include "qtree.h"
+#include "rect.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory_resource>
+#include <numbers>
+#include <optional>
+
+namespace polar {
+
+constexpr static std::size_t default_rings = 32; // Doubled as it fills
+
+// Collision index bucketed by rings around a pole and by sectors within each
+// ring, with the same interface as the quadtree. Ring `k` spans `k` to `k + 1`
+// ring widths from the pole and is cut into about 2 pi (k + 1/2) sectors, so
+// that cells are about square and of equal area. An entry is listed in every
+// cell that its rect's range of radii and angles touches.
+//
+// The pole is the center of the bounds, which cloud_bounds keeps at the
+// center of the circle. A group's spiral stays within its slice, so its probes
+// only visit the cells of that slice, however thin it is
+template <typename T> struct BasicPolarIndex {
+  using Point = BasicPoint<T>;
+  using Rect = BasicRect<T>;
+  using Qbound = qtree::BasicQbound<T>;
+  using Qvalue = qtree::BasicQvalue<T>;
+  using Qhit = qtree::BasicQhit<T>;
+
+  // Range of a rect in polar coordinates, padded so that rounding never
+  // leaves out a cell it touches
+  struct Extent {
+    double r0, r1; // Distances from the pole
+    double a0, a1; // Angles, a0 <= a1, all of them if the rect has the pole
+    bool all_angles;
+  };
+
+  Qbound root_bound;
+  double pole_x;
+  double pole_y;
+  double ring_width;
+  std::pmr::vector<uint32_t> ring_offsets; // First cell of every ring, and end
+  std::pmr::vector<std::pmr::vector<uint32_t>> cells; // Indices into entries
+  std::pmr::vector<Qvalue> entries;
+  std::pmr::vector<uint32_t> free_entries; // Of erased entries, for reuse
+
+  std::size_t refinements = 0;
+
+  QtreeStats stats;
+
+  explicit BasicPolarIndex(Qbound bound,
+                           std::pmr::memory_resource *mem =
+                               std::pmr::get_default_resource())
+      : root_bound{bound},
+        pole_x{(static_cast<double>(bound.rect.lft) + bound.rect.rgt) / 2},
+        pole_y{(static_cast<double>(bound.rect.top) + bound.rect.bot) / 2},
+        ring_offsets{mem}, cells{mem}, entries{mem}, free_entries{mem} {
+    make_cells(default_rings);
+  }
+
+  auto resource() const -> std::pmr::memory_resource * {
+    return entries.get_allocator().resource();
+  }
+  // Grows with every refinement of the cells, see BasicQtree::splits
+  auto splits() const -> std::size_t { return refinements; }
+
+  // Rects outside of the bounds are dropped, as by the quadtree
+  void insert(const Rect &rect, uint32_t id = qtree::no_id) {
+    if (not root_bound.rect.does_overlap(rect)) {
+      return;
+    }
+    if (entries.size() - free_entries.size() >= cells.size()) {
+      refine_cells();
+    }
+    uint32_t entry = entries.size();
+    if (free_entries.empty()) {
+      entries.push_back({rect, id});
+    } else {
+      entry = free_entries.back();
+      free_entries.pop_back();
+      entries[entry] = {rect, id};
+    }
+    visit_cells(extent(rect), [&](std::pmr::vector<uint32_t> &cell) {
+      cell.push_back(entry);
+      return false;
+    });
+  }
+
+  // Takes the entry equal to `rect` and `id` out of every cell it is in
+  void erase(const Rect &rect, uint32_t id = qtree::no_id) {
+    uint32_t entry = qtree::no_id;
+    visit_cells(extent(rect), [&](std::pmr::vector<uint32_t> &cell) {
+      const auto it = std::ranges::find_if(cell, [&](uint32_t i) {
+        return (entry == qtree::no_id || i == entry) &&
+               entries[i].rect == rect && entries[i].id == id;
+      });
+      if (it != cell.end()) {
+        entry = *it;
+        *it = cell.back();
+        cell.pop_back();
+      }
+      return false;
+    });
+    if (entry != qtree::no_id) {
+      free_entries.push_back(entry);
+    }
+  }
+
+  // The first entry found that overlaps `rect` and whose id `refine` accepts.
+  // The bound of a hit is the root bound, as cells never split
+  template <typename Refine = qtree::AcceptAll>
+  [[nodiscard]] auto rect_collider(const Rect &rect, Refine refine = {})
+      -> std::optional<Qhit> {
+    RP_STAT(stats.rect_intersects++);
+    std::optional<Qhit> result;
+    visit_cells(extent(rect), [&](const std::pmr::vector<uint32_t> &cell) {
+      RP_STAT(stats.nodes_visited++);
+      for (const uint32_t i : cell) {
+        RP_STAT(stats.leaf_entries_tested++);
+        if (entries[i].rect.does_overlap(rect) && refine(entries[i].id)) {
+          result = Qhit{entries[i], root_bound};
+          return true;
+        }
+      }
+      return false;
+    });
+    return result;
+  }
+  template <typename Refine = qtree::AcceptAll>
+  [[nodiscard]] auto point_collider(Point p, Refine refine = {})
+      -> std::optional<Qhit> {
+    RP_STAT(stats.point_intersects++);
+    RP_STAT(stats.nodes_visited++);
+    const double x = p.x - pole_x;
+    const double y = p.y - pole_y;
+    const std::size_t ring = ring_of(std::hypot(x, y));
+    const std::size_t n = sectors(ring);
+    const double turn = std::atan2(y, x) / (2 * std::numbers::pi);
+    const auto sector =
+        static_cast<std::ptrdiff_t>(std::floor(turn * _float(n)));
+    for (const uint32_t i : cells[ring_offsets[ring] + wrap(sector, n)]) {
+      RP_STAT(stats.leaf_entries_tested++);
+      if (entries[i].rect.is_point_inside(p) && refine(entries[i].id)) {
+        return Qhit{entries[i], root_bound};
+      }
+    }
+    return std::nullopt;
+  }
+  template <typename Refine = qtree::AcceptAll>
+  [[nodiscard]] auto rect_intersects(const Rect &rect, Refine refine = {})
+      -> bool {
+    return rect_collider(rect, refine).has_value();
+  }
+  template <typename Refine = qtree::AcceptAll>
+  [[nodiscard]] auto point_intersects(Point p, Refine refine = {}) -> bool {
+    return point_collider(p, refine).has_value();
+  }
+
+  [[nodiscard]] auto memory_stats() const -> qtree::MemoryStats {
+    qtree::MemoryStats result{
+        .nodes = cells.size(),
+        .leaves = cells.size(),
+        .free_slots = free_entries.size(),
+        .bytes = cells.size() * sizeof(cells.front()) +
+                 entries.capacity() * sizeof(Qvalue) +
+                 free_entries.capacity() * sizeof(uint32_t),
+    };
+    for (const auto &cell : cells) {
+      result.entries += cell.size();
+      result.entry_slots += cell.capacity();
+      result.bytes += cell.capacity() * sizeof(uint32_t);
+    }
+    return result;
+  }
+
+  auto extent(const Rect &r) const -> Extent {
+    constexpr double pad = 1e-6;
+    const double x0 = r.lft - pole_x;
+    const double x1 = r.rgt - pole_x;
+    const double y0 = r.top - pole_y;
+    const double y1 = r.bot - pole_y;
+    const double near_x = std::clamp(0., x0, x1);
+    const double near_y = std::clamp(0., y0, y1);
+    const double far_x = std::max(-x0, x1);
+    const double far_y = std::max(-y0, y1);
+    Extent result{
+        .r0 = std::hypot(near_x, near_y) * (1 - pad) - pad,
+        .r1 = std::hypot(far_x, far_y) * (1 + pad) + pad,
+        .a0 = 0,
+        .a1 = 0,
+        .all_angles = near_x == 0 && near_y == 0,
+    };
+    if (result.all_angles) {
+      return result;
+    }
+    // Less than half a turn around the angle of the center, as the rect does
+    // not have the pole
+    const double mid = std::atan2(y0 + y1, x0 + x1);
+    double lo = 0;
+    double hi = 0;
+    for (const auto &[x, y] : {std::pair{x0, y0}, std::pair{x1, y0},
+                              std::pair{x0, y1}, std::pair{x1, y1}}) {
+      const double d = std::remainder(std::atan2(y, x) - mid,
+                                      2 * std::numbers::pi);
+      lo = std::min(lo, d);
+      hi = std::max(hi, d);
+    }
+    result.a0 = mid + lo - pad;
+    result.a1 = mid + hi + pad;
+    return result;
+  }
+
+private:
+  // Cells the size of `ring_width` squared, up to the corners of the bounds
+  void make_cells(std::size_t n_rings) {
+    const double reach =
+        std::hypot(root_bound.rect.rgt - pole_x, root_bound.rect.bot - pole_y);
+    ring_width = std::max(reach / _float(n_rings), 1e-3);
+    ring_offsets.clear();
+    uint32_t n_cells = 0;
+    for (std::size_t k = 0; k < n_rings; ++k) {
+      ring_offsets.push_back(n_cells);
+      n_cells += static_cast<uint32_t>(
+          std::ceil(2 * std::numbers::pi * (_float(k) + .5F)));
+    }
+    ring_offsets.push_back(n_cells);
+    cells.assign(n_cells, std::pmr::vector<uint32_t>(cells.get_allocator()));
+  }
+
+  // Twice as many rings, once there are as many entries as cells, so that
+  // cells keep a few entries each
+  void refine_cells() {
+    make_cells(2 * (ring_offsets.size() - 1));
+    ++refinements;
+    std::pmr::vector<bool> erased(entries.size(), false,
+                                  entries.get_allocator());
+    for (const uint32_t entry : free_entries) {
+      erased[entry] = true;
+    }
+    for (uint32_t entry = 0; entry < entries.size(); ++entry) {
+      if (not erased[entry]) {
+        visit_cells(extent(entries[entry].rect),
+                    [entry](std::pmr::vector<uint32_t> &cell) {
+                      cell.push_back(entry);
+                      return false;
+                    });
+      }
+    }
+  }
+
+  auto sectors(std::size_t ring) const -> std::size_t {
+    return ring_offsets[ring + 1] - ring_offsets[ring];
+  }
+  auto ring_of(double r) const -> std::size_t {
+    const auto ring = static_cast<std::size_t>(std::max(r / ring_width, 0.));
+    return std::min(ring, ring_offsets.size() - 2);
+  }
+  static auto wrap(std::ptrdiff_t sector, std::size_t n) -> std::size_t {
+    const auto m = static_cast<std::ptrdiff_t>(n);
+    return static_cast<std::size_t>(((sector % m) + m) % m);
+  }
+
+  // Calls `f` on the cells of `e` until it returns true, and returns whether
+  // it did
+  template <typename F> auto visit_cells(const Extent &e, F f) -> bool {
+    const std::size_t last = ring_of(e.r1);
+    for (std::size_t ring = ring_of(e.r0); ring <= last; ++ring) {
+      const std::size_t n = sectors(ring);
+      auto *first = cells.data() + ring_offsets[ring];
+      if (e.all_angles) {
+        for (std::size_t s = 0; s < n; ++s) {
+          if (f(first[s])) {
+            return true;
+          }
+        }
+        continue;
+      }
+      const double per_turn = _float(n) / (2 * std::numbers::pi);
+      const auto s0 = static_cast<std::ptrdiff_t>(std::floor(e.a0 * per_turn));
+      const auto s1 = std::min(
+          static_cast<std::ptrdiff_t>(std::floor(e.a1 * per_turn)),
+          s0 + static_cast<std::ptrdiff_t>(n) - 1);
+      for (std::ptrdiff_t s = s0; s <= s1; ++s) {
+        if (f(first[wrap(s, n)])) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+};
+
+using PolarIndex = BasicPolarIndex<float>;
+
+} // namespace polar
@@ -4,52 +4,75 @@
 #include "rect.h"
 #include "utils.h"
 
-struct Edge {
-  Point p, q;
+#include <algorithm>
+#include <optional>
 
-  friend auto operator==(const Edge &lhs, const Edge &rhs) -> bool = default;
-  friend auto operator<<(std::ostream &os, const Edge &e) -> std::ostream & {
+template <typename T> struct BasicEdge {
+  BasicPoint<T> p, q;
+
+  friend auto operator==(const BasicEdge &lhs, const BasicEdge &rhs)
+      -> bool = default;
+  friend auto operator<<(std::ostream &os, const BasicEdge &e)
+      -> std::ostream & {
     return os << "Edge{" << e.p << ", " << e.q << "}";
   }
 
-  auto intersection(const Edge &other, Point &out) const -> bool;
+  auto intersection(const BasicEdge &other, BasicPoint<T> &out) const -> bool;
 };
 
+using Edge = BasicEdge<float>;
+
+// Derived buffers (e.g. `PolygonE::edge_points`) are allocated from the memory
+// resource of `rects`
 struct Polygon {
-  std::vector<Rect> rects;
+  Bounds rects;
 
   void simplify(float threshold);
   auto area() const -> float;
-  auto outside_edge_points() -> std::vector<Point>;
+  auto outside_edge_points() -> std::pmr::vector<Point>;
 };
 
 struct PolygonE : Polygon {
-  std::vector<Point> edge_points = outside_edge_points();
+  std::pmr::vector<Point> edge_points = outside_edge_points();
   Point center = centroid();
+  int orientation = HORIZONTAL; // VERTICAL if made by `turned`
+  bool compound = false; // Stands for a packed sub-cloud, see hierarchy.h
 
-  auto closest_isect(float theta, Point &out) const -> bool;
+  // Closest point of the outline hit by a ray from `center` along the unit
+  // vector `dir`
+  auto closest_isect(Point dir, Point &out) const -> bool;
   auto centroid() -> Point;
   void move_by(Point vector);
 };
 
+// `p` turned by 90 degrees about the top left corner of its bounding box,
+// (x, y) -> (lft + bot - y, top + x - lft), and cut into columns again. None if
+// a row of `p` is not a single run of its rects, the turned shape would then
+// have a column of more than one piece
+inline auto turned(const Polygon &p) -> std::optional<PolygonE>;
+
 inline auto Polygon::area() const -> float {
   return accumulate(rects, 0.F, _plus_, &Rect::area);
 }
 
-inline auto Edge::intersection(const Edge &other, Point &out) const -> bool {
-  const float s1_x = q.x - p.x;
-  const float s1_y = q.y - p.y;
-  const float s2_x = other.q.x - other.p.x;
-  const float s2_y = other.q.y - other.p.y;
+// Integral edges intersect in double precision, the result is rounded
+template <typename T>
+inline auto BasicEdge<T>::intersection(const BasicEdge &other,
+                                       BasicPoint<T> &out) const -> bool {
+  using F = std::conditional_t<std::is_integral_v<T>, double, T>;
+  const F s1_x = q.x - p.x;
+  const F s1_y = q.y - p.y;
+  const F s2_x = other.q.x - other.p.x;
+  const F s2_y = other.q.y - other.p.y;
 
-  const float s = (-s1_y * (p.x - other.p.x) + s1_x * (p.y - other.p.y)) /
-                  (-s2_x * s1_y + s1_x * s2_y);
-  const float t = (s2_x * (p.y - other.p.y) - s2_y * (p.x - other.p.x)) /
-                  (-s2_x * s1_y + s1_x * s2_y);
+  const F s = (-s1_y * (p.x - other.p.x) + s1_x * (p.y - other.p.y)) /
+              (-s2_x * s1_y + s1_x * s2_y);
+  const F t = (s2_x * (p.y - other.p.y) - s2_y * (p.x - other.p.x)) /
+              (-s2_x * s1_y + s1_x * s2_y);
 
   if (s >= 0 && s <= 1 && t >= 0 && t <= 1) {
-    out.x = p.x + (t * s1_x);
-    out.y = p.y + (t * s1_y);
+    out.x = coord_cast<T>(p.x + (t * s1_x));
+    out.y = coord_cast<T>(p.y + (t * s1_y));
     return true;
   }
   return false;
@@ -102,13 +125,13 @@ inline void Polygon::simplify(float threshold) {
   }
 }
 
-inline auto Polygon::outside_edge_points() -> std::vector<Point> {
+inline auto Polygon::outside_edge_points() -> std::pmr::vector<Point> {
   if (rects.empty()) {
-    return {};
+    return std::pmr::vector<Point>{rects.get_allocator()};
   }
   const Point first = rects.front().bl();
   Point curr_point = rects.front().tl();
-  std::vector<Point> result{curr_point};
+  std::pmr::vector<Point> result{{curr_point}, rects.get_allocator()};
   Rect *next, *curr = &rects.front();
   enum Corner { BL, TL, BR, TR } curr_corner = TL;
   auto add_point = [&](Point p, Corner c) {
@@ -168,12 +191,12 @@ inline void PolygonE::move_by(Point vector) {
   center = center + vector;
 }
 
-inline auto PolygonE::closest_isect(float theta, Point &out) const -> bool {
+inline auto PolygonE::closest_isect(Point dir, Point &out) const -> bool {
   constexpr float far = 10000.F;
   Point closest{nanf(""), nanf("")};
   float min_dist = std::numeric_limits<float>::max();
 
-  Edge ray{center, center + Point{cosf(theta) * far, sinf(theta) * far}};
+  Edge ray{center, center + Point{dir.x * far, dir.y * far}};
   for (int i = edge_points.size() - 1, j = 0; j < edge_points.size(); i = j++) {
     Edge edge{edge_points[i], edge_points[j]};
     if (Point isect; edge.intersection(ray, isect)) {
@@ -191,6 +214,53 @@ inline auto PolygonE::closest_isect(float theta, Point &out) const -> bool {
   return false;
 }
 
+inline auto turned(const Polygon &p) -> std::optional<PolygonE> {
+  std::pmr::vector<float> ys(p.rects.get_allocator());
+  for (const Rect &r : p.rects) {
+    ys.push_back(r.top);
+    ys.push_back(r.bot);
+  }
+  std::ranges::sort(ys);
+  ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+  const float lft = p.rects.front().lft;
+  const float top = ys.front();
+  const float bot = ys.back();
+
+  // Rows from the bottom up turn into columns from left to right
+  Bounds columns(p.rects.get_allocator());
+  for (std::size_t i = ys.size() - 1; i > 0; --i) {
+    const float y0 = ys[i - 1];
+    const float y1 = ys[i];
+    std::optional<Rect> row; // Spanned by the rects across the row
+    for (const Rect &r : p.rects) {
+      if (r.top > y0 || r.bot < y1) {
+        continue;
+      }
+      if (not row) {
+        row = r;
+      } else if (r.lft > row->rgt) {
+        return std::nullopt;
+      } else {
+        row->rgt = std::max(row->rgt, r.rgt);
+      }
+    }
+    if (not row) {
+      return std::nullopt;
+    }
+    const Rect column{lft + (bot - y1), top + (row->lft - lft),
+                      lft + (bot - y0), top + (row->rgt - lft)};
+    if (not columns.empty() && columns.back().top == column.top &&
+        columns.back().bot == column.bot) {
+      columns.back().rgt = column.rgt;
+    } else {
+      columns.push_back(column);
+    }
+  }
+  PolygonE result{Polygon{std::move(columns)}};
+  result.orientation = VERTICAL;
+  return result;
+}
+
 inline auto PolygonE::centroid() -> Point {
   if (edge_points.empty()) {
     return {};
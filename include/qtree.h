@@ -1,20 +1,35 @@
 #pragma once
 
+#include "defines.h"
 #include "rect.h"
 #include "small_list.h"
+#include "stats.h"
 
+#include <algorithm>
+#include <bit>
 #include <deque>
 #include <limits>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <tuple>
 
 namespace qtree {
 
 constexpr static char8_t qtree_capacity = 8;
-
-struct Qtree;
-struct Qbound;
+constexpr static uint32_t no_id = std::numeric_limits<uint32_t>::max();
+
+// The tree is templated on the coordinate type of the rects it stores, see
+// rect.h. `Qtree` is the float instantiation the engine uses. With `Quantized`
+// an integral tree stores its leaf entries as 16-bit offsets from the top left
+// corner of their leaf, which halves the leaf storage of an `IQtree`. With
+// `Ids` every entry carries an id, which queries hand to a refinement
+// predicate, see rect_collider
+template <typename T, bool Quantized = false, bool Ids = false>
+struct BasicQtree;
+template <typename T> struct BasicQbound;
 struct Qnode;
 
-using QvalueArray = std::array<Rect, qtree_capacity>;
 using Qsubdivision = std::array<Qnode, 4>;
 
 enum Qquadrant : uint16_t {
@@ -24,109 +39,328 @@ enum Qquadrant : uint16_t {
   BotRgt,
 };
 
+// Leaves only hold as many entry slots as the size class of their size needs,
+// see BasicQtree::leaf_values. A leaf holds more than `qtree_capacity` entries
+// only when they all share an area, which no split could separate
 struct Qnode {
-  uint16_t ptr = -1; // Pointer to the data, or children if it's not a leaf
+  uint32_t ptr = -1; // Index of the slot, overflow list or children
   uint16_t size{};   // std::numeric_limits::max() when this is not a leaf node
 
-  auto init_leaf(Qtree &parent) -> QvalueArray &;
-  auto values(Qtree &parent) const -> QvalueArray &;
-  auto children(Qtree &parent) const -> Qsubdivision &;
-  void insert(Qbound const &bound, Rect const &rect, Qtree &parent);
-
   constexpr auto is_leaf() const -> bool {
     return size != std::numeric_limits<decltype(size)>::max();
   }
 };
 
-struct Qbound {
-  Rect rect;
+template <typename T> struct BasicQbound {
+  BasicRect<T> rect;
 
-  template <Qquadrant quadrant> constexpr auto divide() const -> Qbound;
+  template <Qquadrant quadrant> constexpr auto divide() const -> BasicQbound;
 };
 
-struct Qeval {
+template <typename T> struct BasicQeval {
   Qnode node;
-  Qbound bound;
+  BasicQbound<T> bound;
 };
 
-struct Qinsert {
+template <typename T> struct BasicQinsert {
   Qnode *node;
-  Qbound bound;
+  BasicQbound<T> bound;
+};
+
+// A leaf entry as inserted and queried, whatever its stored form
+template <typename T> struct BasicQvalue {
+  BasicRect<T> rect;
+  uint32_t id = no_id;
+};
+
+// An entry found by a query, with the bound of the leaf it was found in. Until
+// that leaf splits, a query overlapping both finds an entry
+template <typename T> struct BasicQhit {
+  BasicQvalue<T> value;
+  BasicQbound<T> leaf;
+};
+
+template <typename R> struct Identified {
+  R rect;
+  uint32_t id;
+};
+
+struct AcceptAll {
+  constexpr auto operator()(uint32_t /*id*/) const -> bool { return true; }
+};
+
+struct MemoryStats {
+  std::size_t nodes = 0;       // Leaves and inner nodes
+  std::size_t leaves = 0;      // Including the empty ones, which hold no slot
+  std::size_t entries = 0;     // Stored in leaves, a rect may be in several
+  std::size_t entry_slots = 0; // Allocated, including the free ones
+  std::size_t free_slots = 0;  // Waiting in a free list for reuse
+  std::size_t bytes = 0;       // Of nodes and slots
+};
+
+// Leaf slots of 1, 2, 4 and 8 entries, each size class with its own free list
+template <typename Entry> struct SlotPool {
+  template <std::size_t N> struct Class {
+    std::pmr::deque<std::array<Entry, N>> slots;
+    std::pmr::vector<uint32_t> free;
+
+    explicit Class(std::pmr::memory_resource *mem) : slots{mem}, free{mem} {}
+  };
+
+  std::tuple<Class<1>, Class<2>, Class<4>, Class<8>> classes;
+
+  explicit SlotPool(std::pmr::memory_resource *mem)
+      : classes{mem, mem, mem, mem} {}
+
+  // Size 1 is in class 0, 2 in class 1, 3 to 4 in class 2 and 5 to 8 in 3
+  static constexpr auto size_class(std::size_t size) -> std::size_t {
+    return std::bit_width(size - 1);
+  }
+
+  auto data(std::size_t cls, uint32_t ptr) -> Entry * {
+    return visit(cls, [ptr](auto &c) { return c.slots[ptr].data(); });
+  }
+  auto allocate(std::size_t cls) -> uint32_t {
+    return visit(cls, [](auto &c) -> uint32_t {
+      if (c.free.empty()) {
+        c.slots.emplace_back();
+        CUSTOM_ASSERT(c.slots.size() <= std::numeric_limits<uint32_t>::max());
+        return c.slots.size() - 1;
+      }
+      const uint32_t ptr = c.free.back();
+      c.free.pop_back();
+      return ptr;
+    });
+  }
+  void deallocate(std::size_t cls, uint32_t ptr) {
+    visit(cls, [ptr](auto &c) { c.free.push_back(ptr); });
+  }
+
+  template <typename F> auto visit(std::size_t cls, F f) -> decltype(auto) {
+    switch (cls) {
+    case 0:
+      return f(std::get<0>(classes));
+    case 1:
+      return f(std::get<1>(classes));
+    case 2:
+      return f(std::get<2>(classes));
+    default:
+      CUSTOM_ASSERT(cls == 3);
+      return f(std::get<3>(classes));
+    }
+  }
 };
 
-struct Qtree {
+template <typename T, bool Quantized, bool Ids> struct BasicQtree {
+  static_assert(not Quantized || std::is_integral_v<T>,
+                "Only integral coordinates are quantized losslessly");
+
+  using Point = BasicPoint<T>;
+  using Rect = BasicRect<T>;
+  using Qbound = BasicQbound<T>;
+  using Qeval = BasicQeval<T>;
+  using Qinsert = BasicQinsert<T>;
+  using Qvalue = BasicQvalue<T>;
+  using Qhit = BasicQhit<T>;
+  using Stored =
+      std::conditional_t<Quantized, BasicRect<std::int16_t>, BasicRect<T>>;
+  using Entry = std::conditional_t<Ids, Identified<Stored>, Stored>;
+
   Qbound root_bound;
 
   Qnode root{0, 0};
 
-  std::deque<Qsubdivision> children;
-  std::deque<QvalueArray> values{1};
+  std::pmr::deque<Qsubdivision> children;
+  SlotPool<Entry> slots;
+  std::pmr::deque<std::pmr::vector<Entry>> overflows;
+  // Emptied overflow lists, kept with their capacity for reuse
+  std::pmr::vector<uint32_t> free_overflows;
 
   std::array<Qinsert, 128> insert_list_data;
   std::array<Qeval, 128> eval_list_data;
 
-  void insert(const Rect &rect);
-  void split_node(Qnode *node, Qbound const &bound, Rect const &r);
-  [[nodiscard]] auto rect_intersects(const Rect &rect) -> bool;
-  template <Qquadrant quadrant>
-  [[nodiscard]] auto r_intersects(Rect const &r, Qbound const &b,
-                                  Qnode n) -> bool;
-  [[nodiscard]] auto point_intersects(Point p) -> bool;
-  template <Qquadrant quadrant>
-  [[nodiscard]] auto p_intersects(Point p, Qbound const &b, Qnode n) -> bool;
-  [[nodiscard]] auto bounds() -> std::vector<Qbound>;
-};
+  QtreeStats stats;
 
-inline auto Qnode::init_leaf(Qtree &parent) -> QvalueArray & {
-  ptr = parent.values.size();
-  return parent.values.emplace_back();
-}
+  explicit BasicQtree(Qbound bound, std::pmr::memory_resource *mem =
+                                        std::pmr::get_default_resource())
+      : root_bound{bound}, children{mem}, slots{mem}, overflows{mem},
+        free_overflows{mem} {}
 
-inline auto Qnode::children(Qtree &parent) const -> Qsubdivision & {
-  return parent.children.at(ptr);
-}
+  auto resource() const -> std::pmr::memory_resource * {
+    return children.get_allocator().resource();
+  }
+  // Grows with every split, which moves entries into other leaves
+  auto splits() const -> std::size_t { return children.size(); }
+
+  // `id` is only kept with `Ids`
+  void insert(const Rect &rect, uint32_t id = no_id);
+  // Takes an entry equal to `rect` and `id` out of every leaf it was inserted
+  // into. Leaves that empty out are not merged back
+  void erase(const Rect &rect, uint32_t id = no_id);
+  void split_node(Qnode *node, Qbound const &bound, Qvalue const &v);
+  // Splits a full leaf, unless `v` and all of its entries share an area
+  void add_value(Qnode &node, Qbound const &bound, Qvalue const &v);
+  // The first entry found that overlaps `rect` and whose id `refine` accepts.
+  // With ids, an entry can stand for a group of rects bounded by it, which
+  // `refine` tests
+  template <typename Refine = AcceptAll>
+  [[nodiscard]] auto rect_collider(const Rect &rect, Refine refine = {})
+      -> std::optional<Qhit>;
+  template <typename Refine = AcceptAll>
+  [[nodiscard]] auto point_collider(Point p, Refine refine = {})
+      -> std::optional<Qhit>;
+  template <typename Refine = AcceptAll>
+  [[nodiscard]] auto rect_intersects(const Rect &rect, Refine refine = {})
+      -> bool {
+    return rect_collider(rect, refine).has_value();
+  }
+  template <typename Refine = AcceptAll>
+  [[nodiscard]] auto point_intersects(Point p, Refine refine = {}) -> bool {
+    return point_collider(p, refine).has_value();
+  }
+  [[nodiscard]] auto bounds() -> std::vector<Qbound>;
+  [[nodiscard]] auto memory_stats() -> MemoryStats;
 
-inline auto Qnode::values(Qtree &parent) const -> QvalueArray & {
-  return parent.values.at(ptr);
-}
+  auto leaf_values(Qnode node) -> std::span<Entry> {
+    if (node.size == 0) {
+      return {};
+    }
+    if (node.size > qtree_capacity) [[unlikely]] {
+      return overflows[node.ptr];
+    }
+    return {slots.data(SlotPool<Entry>::size_class(node.size), node.ptr),
+            node.size};
+  }
+  auto child_nodes(Qnode node) -> Qsubdivision & {
+    return children.at(node.ptr);
+  }
+  // Appends `v` to a leaf, moving it to a larger slot or to an overflow list
+  // if needed
+  void push_value(Qnode &node, Qbound const &bound, Qvalue const &v);
+  // Removes the `i`th entry of a leaf, moving it to a smaller slot if needed
+  void remove_value(Qnode &node, std::size_t i);
+
+  // Leaf entries relative to the top left corner of the leaf when quantized
+  static auto encode(Qvalue const &v, Qbound const &b) -> Entry {
+    const Rect &r = v.rect;
+    Stored stored;
+    if constexpr (Quantized) {
+      auto offset = [](T v, T origin) {
+        const T result = v - origin;
+        CUSTOM_ASSERT(result >= std::numeric_limits<std::int16_t>::min() &&
+                      result <= std::numeric_limits<std::int16_t>::max());
+        return static_cast<std::int16_t>(result);
+      };
+      stored = {offset(r.lft, b.rect.lft), offset(r.top, b.rect.top),
+                offset(r.rgt, b.rect.lft), offset(r.bot, b.rect.top)};
+    } else {
+      stored = r;
+    }
+    if constexpr (Ids) {
+      return {stored, v.id};
+    } else {
+      return stored;
+    }
+  }
+  static auto decode(Entry const &e, Qbound const &b) -> Qvalue {
+    const Stored *stored;
+    uint32_t id = no_id;
+    if constexpr (Ids) {
+      stored = &e.rect;
+      id = e.id;
+    } else {
+      stored = &e;
+    }
+    if constexpr (Quantized) {
+      return {{b.rect.lft + stored->lft, b.rect.top + stored->top,
+               b.rect.lft + stored->rgt, b.rect.top + stored->bot},
+              id};
+    } else {
+      return {*stored, id};
+    }
+  }
+};
 
-template <Qquadrant quadrant> constexpr auto Qbound::divide() const -> Qbound {
-  const float half_rgt = rect.lft + rect.w() / 2;
-  const float half_bot = rect.top + rect.h() / 2;
+template <typename T>
+template <Qquadrant quadrant>
+constexpr auto BasicQbound<T>::divide() const -> BasicQbound {
+  const T half_rgt = rect.lft + rect.w() / 2;
+  const T half_bot = rect.top + rect.h() / 2;
   if constexpr (quadrant == TopLft) {
-    return {Rect{rect.lft, rect.top, half_rgt, half_bot}};
+    return {{rect.lft, rect.top, half_rgt, half_bot}};
   } else if constexpr (quadrant == TopRgt) {
-    return {Rect{half_rgt, rect.top, rect.rgt, half_bot}};
+    return {{half_rgt, rect.top, rect.rgt, half_bot}};
   } else if constexpr (quadrant == BotLft) {
-    return {Rect{rect.lft, half_bot, half_rgt, rect.bot}};
+    return {{rect.lft, half_bot, half_rgt, rect.bot}};
   } else if constexpr (quadrant == BotRgt) {
-    return {Rect{half_rgt, half_bot, rect.rgt, rect.bot}};
+    return {{half_rgt, half_bot, rect.rgt, rect.bot}};
   } else {
     static_assert(false, "Unreachable");
   }
 }
 
-inline void Qtree::insert(const Rect &r) {
+template <typename T, bool Quantized, bool Ids>
+inline void BasicQtree<T, Quantized, Ids>::push_value(Qnode &node,
+                                                      Qbound const &bound,
+                                                      Qvalue const &v) {
+  using Pool = SlotPool<Entry>;
+  CUSTOM_ASSERT(node.size < std::numeric_limits<uint16_t>::max() - 1);
+  if (node.size >= qtree_capacity) [[unlikely]] {
+    if (node.size == qtree_capacity) {
+      const std::span<Entry> full = leaf_values(node);
+      uint32_t ptr = 0;
+      if (free_overflows.empty()) {
+        overflows.emplace_back(full.begin(), full.end());
+        CUSTOM_ASSERT(overflows.size() <=
+                      std::numeric_limits<uint32_t>::max());
+        ptr = overflows.size() - 1;
+      } else {
+        ptr = free_overflows.back();
+        free_overflows.pop_back();
+        overflows[ptr].assign(full.begin(), full.end());
+      }
+      slots.deallocate(Pool::size_class(qtree_capacity), node.ptr);
+      node.ptr = ptr;
+    }
+    overflows[node.ptr].push_back(encode(v, bound));
+    ++node.size;
+    return;
+  }
+  const std::size_t cls = Pool::size_class(node.size + 1);
+  if (node.size == 0) {
+    node.ptr = slots.allocate(cls);
+  } else if (const std::size_t old_cls = Pool::size_class(node.size);
+             cls != old_cls) {
+    const uint32_t ptr = slots.allocate(cls);
+    std::copy_n(slots.data(old_cls, node.ptr), node.size,
+                slots.data(cls, ptr));
+    slots.deallocate(old_cls, node.ptr);
+    node.ptr = ptr;
+  }
+  slots.data(cls, node.ptr)[node.size++] = encode(v, bound);
+}
+
+template <typename T, bool Quantized, bool Ids>
+inline void BasicQtree<T, Quantized, Ids>::insert(const Rect &r, uint32_t id) {
   if (not root_bound.rect.does_overlap(r)) [[unlikely]] {
     return;
   }
+  const Qvalue value{r, id};
 
-  SmallList stack{std::span{insert_list_data}};
+  SmallList stack{std::span{insert_list_data},
+                  std::pmr::vector<Qinsert>(resource()), 0,
+                  &stats.overflow_spills};
   stack.emplace_back(&root, root_bound);
   while (not stack.is_empty()) {
     auto [top_node, top_bound] = stack.pop_back();
 
     if (top_node->is_leaf()) {
-      if (top_node->size == qtree_capacity) {
-        split_node(top_node, top_bound, r);
-      } else {
-        top_node->values(*this)[top_node->size++] = r;
-      }
+      add_value(*top_node, top_bound, value);
     } else {
-      auto &child_nodes = top_node->children(*this);
+      auto &nodes = child_nodes(*top_node);
       auto emplace = [&]<Qquadrant qd>(std::integral_constant<Qquadrant, qd>) {
-        const Qbound div = top_bound.divide<qd>();
-        Qnode &qnode = child_nodes.at(qd);
+        const Qbound div = top_bound.template divide<qd>();
+        Qnode &qnode = nodes.at(qd);
         if (div.rect.does_overlap(r)) {
           stack.emplace_back(&qnode, div);
         }
@@ -139,27 +373,45 @@ inline void Qtree::insert(const Rect &r) {
   }
 }
 
-inline void Qtree::split_node(Qnode *node, Qbound const &bound, Rect const &r) {
-  QvalueArray &values = node->values(*this);
-  const Qbound div = bound.divide<TopLft>();
+// The slot or overflow list of the full leaf is released for reuse once its
+// entries are distributed, and children that receive no entry get no slot
+template <typename T, bool Quantized, bool Ids>
+inline void BasicQtree<T, Quantized, Ids>::split_node(Qnode *node,
+                                                      Qbound const &bound,
+                                                      Qvalue const &value) {
+  std::array<Qvalue, qtree_capacity> inline_values;
+  std::pmr::vector<Qvalue> overflow_values(resource());
+  std::span<Qvalue> values = inline_values;
+  const auto old_values = leaf_values(*node);
+  CUSTOM_ASSERT(old_values.size() >= qtree_capacity);
+  if (old_values.size() > qtree_capacity) {
+    overflow_values.resize(old_values.size());
+    values = overflow_values;
+  }
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    values[i] = decode(old_values[i], bound);
+  }
+  if (old_values.size() > qtree_capacity) {
+    overflows[node->ptr].clear();
+    free_overflows.push_back(node->ptr);
+  } else {
+    slots.deallocate(SlotPool<Entry>::size_class(qtree_capacity), node->ptr);
+  }
+
+  CUSTOM_ASSERT(children.size() < std::numeric_limits<uint32_t>::max());
   node->ptr = children.size();
   Qsubdivision &node_children = children.emplace_back();
   node->size = -1;
   auto append = [&]<Qquadrant qd>(std::integral_constant<Qquadrant, qd>) {
-    const Qbound div = bound.divide<qd>();
-    auto &node = node_children[qd];
-    auto &node_values = node.init_leaf(*this);
+    const Qbound div = bound.template divide<qd>();
+    auto &child = node_children[qd];
     for (auto &v : values) {
-      if (div.rect.does_overlap(v)) {
-        node_values[node.size++] = v;
+      if (div.rect.does_overlap(v.rect)) {
+        push_value(child, div, v);
       }
     }
-    if (div.rect.does_overlap(r)) {
-      if (node.size == qtree_capacity) {
-        split_node(&node, div, r);
-      } else {
-        node_values[node.size++] = r;
-      }
+    if (div.rect.does_overlap(value.rect)) {
+      add_value(child, div, value);
     }
   };
   append(std::integral_constant<Qquadrant, TopLft>{});
@@ -168,106 +420,218 @@ inline void Qtree::split_node(Qnode *node, Qbound const &bound, Rect const &r) {
   append(std::integral_constant<Qquadrant, BotRgt>{});
 }
 
-inline auto Qtree::rect_intersects(const Rect &r) -> bool {
+template <typename T, bool Quantized, bool Ids>
+inline void BasicQtree<T, Quantized, Ids>::remove_value(Qnode &node,
+                                                        std::size_t i) {
+  using Pool = SlotPool<Entry>;
+  const std::span<Entry> values = leaf_values(node);
+  CUSTOM_ASSERT(i < values.size());
+  values[i] = values.back();
+  const std::size_t size = node.size - 1;
+  if (node.size > qtree_capacity) [[unlikely]] {
+    std::pmr::vector<Entry> &overflow = overflows[node.ptr];
+    overflow.pop_back();
+    if (size == qtree_capacity) {
+      const uint32_t ptr = slots.allocate(Pool::size_class(size));
+      std::ranges::copy(overflow, slots.data(Pool::size_class(size), ptr));
+      overflow.clear();
+      free_overflows.push_back(node.ptr);
+      node.ptr = ptr;
+    }
+  } else if (size == 0) {
+    slots.deallocate(Pool::size_class(node.size), node.ptr);
+  } else if (const std::size_t cls = Pool::size_class(size),
+             old_cls = Pool::size_class(node.size);
+             cls != old_cls) {
+    const uint32_t ptr = slots.allocate(cls);
+    std::copy_n(slots.data(old_cls, node.ptr), size, slots.data(cls, ptr));
+    slots.deallocate(old_cls, node.ptr);
+    node.ptr = ptr;
+  }
+  node.size = size;
+}
+
+template <typename T, bool Quantized, bool Ids>
+inline void BasicQtree<T, Quantized, Ids>::erase(const Rect &r, uint32_t id) {
   if (not root_bound.rect.does_overlap(r)) [[unlikely]] {
-    return false;
+    return;
   }
 
-  SmallList stack{std::span{eval_list_data}};
+  SmallList stack{std::span{insert_list_data},
+                  std::pmr::vector<Qinsert>(resource()), 0,
+                  &stats.overflow_spills};
+  stack.emplace_back(&root, root_bound);
+  while (not stack.is_empty()) {
+    auto [top_node, top_bound] = stack.pop_back();
+
+    if (top_node->is_leaf()) {
+      const std::span<Entry> values = leaf_values(*top_node);
+      const auto it = std::ranges::find_if(values, [&](const Entry &e) {
+        const Qvalue v = decode(e, top_bound);
+        return v.rect == r && v.id == id;
+      });
+      if (it != values.end()) {
+        remove_value(*top_node, it - values.begin());
+      }
+    } else {
+      auto &nodes = child_nodes(*top_node);
+      auto emplace = [&]<Qquadrant qd>(std::integral_constant<Qquadrant, qd>) {
+        const Qbound div = top_bound.template divide<qd>();
+        if (div.rect.does_overlap(r)) {
+          stack.emplace_back(&nodes.at(qd), div);
+        }
+      };
+      emplace(std::integral_constant<Qquadrant, TopLft>{});
+      emplace(std::integral_constant<Qquadrant, TopRgt>{});
+      emplace(std::integral_constant<Qquadrant, BotLft>{});
+      emplace(std::integral_constant<Qquadrant, BotRgt>{});
+    }
+  }
+}
+
+// Entries that all overlap a common area within the leaf would all end up in
+// the child containing it, at any depth. A leaf that spilled over for that
+// reason still splits once a value comes that does not overlap the area
+template <typename T, bool Quantized, bool Ids>
+inline void BasicQtree<T, Quantized, Ids>::add_value(Qnode &node,
+                                                     Qbound const &bound,
+                                                     Qvalue const &value) {
+  if (node.size < qtree_capacity) {
+    push_value(node, bound, value);
+    return;
+  }
+  Rect shared = bound.rect;
+  for (const Entry &e : leaf_values(node)) {
+    const Rect r = decode(e, bound).rect;
+    shared = {std::max(shared.lft, r.lft), std::max(shared.top, r.top),
+              std::min(shared.rgt, r.rgt), std::min(shared.bot, r.bot)};
+  }
+  if (shared.does_overlap(value.rect) && shared.does_overlap(shared)) {
+    push_value(node, bound, value);
+  } else {
+    split_node(&node, bound, value);
+  }
+}
+
+template <typename T, bool Quantized, bool Ids>
+template <typename Refine>
+inline auto BasicQtree<T, Quantized, Ids>::rect_collider(const Rect &r,
+                                                         Refine refine)
+    -> std::optional<Qhit> {
+  RP_STAT(stats.rect_intersects++);
+  if (not root_bound.rect.does_overlap(r)) [[unlikely]] {
+    return std::nullopt;
+  }
+
+  SmallList stack{std::span{eval_list_data},
+                  std::pmr::vector<Qeval>(resource()), 0,
+                  &stats.overflow_spills};
   stack.emplace_back(root, root_bound);
   while (not stack.is_empty()) {
     auto [top_node, top_bound] = stack.pop_back();
+    RP_STAT(stats.nodes_visited++);
 
     if (top_node.is_leaf()) {
-      for (uint16_t i = 0; i < top_node.size; ++i) {
-        if (top_node.values(*this)[i].does_overlap(r)) {
-          return true;
+      for (const Entry &e : leaf_values(top_node)) {
+        RP_STAT(stats.leaf_entries_tested++);
+        const Qvalue v = decode(e, top_bound);
+        if (v.rect.does_overlap(r) && refine(v.id)) {
+          return Qhit{v, top_bound};
         }
       }
     } else {
-      const auto &child_nodes = top_node.children(*this);
-      
-      auto tld = top_bound.divide<TopLft>();
-      auto trd = top_bound.divide<TopRgt>();
-      auto bld = top_bound.divide<BotLft>();
-      auto brd = top_bound.divide<BotRgt>();
+      const auto &nodes = child_nodes(top_node);
+
+      auto tld = top_bound.template divide<TopLft>();
+      auto trd = top_bound.template divide<TopRgt>();
+      auto bld = top_bound.template divide<BotLft>();
+      auto brd = top_bound.template divide<BotRgt>();
 
       if (tld.rect.does_overlap(r)) {
-        stack.emplace_back(child_nodes.at(TopLft), tld);
+        stack.emplace_back(nodes.at(TopLft), tld);
       }
       if (trd.rect.does_overlap(r)) {
-        stack.emplace_back(child_nodes.at(TopRgt), trd);
+        stack.emplace_back(nodes.at(TopRgt), trd);
       }
       if (bld.rect.does_overlap(r)) {
-        stack.emplace_back(child_nodes.at(BotLft), bld);
+        stack.emplace_back(nodes.at(BotLft), bld);
       }
       if (brd.rect.does_overlap(r)) {
-        stack.emplace_back(child_nodes.at(BotRgt), brd);
+        stack.emplace_back(nodes.at(BotRgt), brd);
       }
     }
   }
-  return false;
+  return std::nullopt;
 }
 
-inline auto Qtree::point_intersects(Point p) -> bool {
+template <typename T, bool Quantized, bool Ids>
+template <typename Refine>
+inline auto BasicQtree<T, Quantized, Ids>::point_collider(Point p,
+                                                          Refine refine)
+    -> std::optional<Qhit> {
+  RP_STAT(stats.point_intersects++);
   if (not root_bound.rect.is_point_inside(p)) [[unlikely]] {
-    return false;
+    return std::nullopt;
   }
 
-  SmallList stack{std::span{eval_list_data}};
+  SmallList stack{std::span{eval_list_data},
+                  std::pmr::vector<Qeval>(resource()), 0,
+                  &stats.overflow_spills};
   stack.emplace_back(root, root_bound);
   while (not stack.is_empty()) {
     auto [top_node, top_bound] = stack.pop_back();
+    RP_STAT(stats.nodes_visited++);
 
     if (top_node.is_leaf()) {
-      for (uint16_t i = 0; i < top_node.size; ++i) {
-        if (top_node.values(*this)[i].is_point_inside(p)) {
-          return true;
+      for (const Entry &e : leaf_values(top_node)) {
+        RP_STAT(stats.leaf_entries_tested++);
+        const Qvalue v = decode(e, top_bound);
+        if (v.rect.is_point_inside(p) && refine(v.id)) {
+          return Qhit{v, top_bound};
         }
       }
     } else {
-      auto tld = top_bound.divide<TopLft>();
-      auto trd = top_bound.divide<TopRgt>();
-      auto bld = top_bound.divide<BotLft>();
-      auto brd = top_bound.divide<BotRgt>();
+      auto tld = top_bound.template divide<TopLft>();
+      auto trd = top_bound.template divide<TopRgt>();
+      auto bld = top_bound.template divide<BotLft>();
+      auto brd = top_bound.template divide<BotRgt>();
 
-      const auto &child_nodes = top_node.children(*this);
+      const auto &nodes = child_nodes(top_node);
       if (tld.rect.is_point_inside(p)) {
-        stack.emplace_back(child_nodes.at(TopLft), tld);
+        stack.emplace_back(nodes.at(TopLft), tld);
       }
       if (trd.rect.is_point_inside(p)) {
-        stack.emplace_back(child_nodes.at(TopRgt), trd);
+        stack.emplace_back(nodes.at(TopRgt), trd);
       }
       if (bld.rect.is_point_inside(p)) {
-        stack.emplace_back(child_nodes.at(BotLft), bld);
+        stack.emplace_back(nodes.at(BotLft), bld);
       }
       if (brd.rect.is_point_inside(p)) {
-        stack.emplace_back(child_nodes.at(BotRgt), brd);
+        stack.emplace_back(nodes.at(BotRgt), brd);
       }
     }
   }
-  return false;
+  return std::nullopt;
 }
 
-template <Qquadrant quadrant>
-inline void bound_recurse(Qbound b, Qnode node, std::vector<Qbound> &result,
-                          Qtree &parent) {
-  const Qbound bound = b.divide<quadrant>();
+template <Qquadrant quadrant, typename T, bool Quantized, bool Ids>
+inline void bound_recurse(BasicQbound<T> b, Qnode node,
+                          std::vector<BasicQbound<T>> &result,
+                          BasicQtree<T, Quantized, Ids> &parent) {
+  const BasicQbound<T> bound = b.template divide<quadrant>();
   if (not node.is_leaf()) {
-    bound_recurse<TopLft>(bound, node.children(parent).at(TopLft), result,
-                          parent);
-    bound_recurse<TopRgt>(bound, node.children(parent).at(TopRgt), result,
-                          parent);
-    bound_recurse<BotLft>(bound, node.children(parent).at(BotLft), result,
-                          parent);
-    bound_recurse<BotRgt>(bound, node.children(parent).at(BotRgt), result,
-                          parent);
+    const auto &nodes = parent.child_nodes(node);
+    bound_recurse<TopLft>(bound, nodes.at(TopLft), result, parent);
+    bound_recurse<TopRgt>(bound, nodes.at(TopRgt), result, parent);
+    bound_recurse<BotLft>(bound, nodes.at(BotLft), result, parent);
+    bound_recurse<BotRgt>(bound, nodes.at(BotRgt), result, parent);
   } else {
     result.push_back(bound);
   }
 }
 
-inline auto Qtree::bounds() -> std::vector<Qbound> {
+template <typename T, bool Quantized, bool Ids>
+inline auto BasicQtree<T, Quantized, Ids>::bounds() -> std::vector<Qbound> {
   std::vector<Qbound> result{root_bound};
   if (children.size() > 0) {
     bound_recurse<TopLft>(root_bound, children.front().at(TopLft), result,
@@ -282,4 +646,51 @@ inline auto Qtree::bounds() -> std::vector<Qbound> {
   return result;
 }
 
+template <typename T, bool Quantized, bool Ids>
+inline auto BasicQtree<T, Quantized, Ids>::memory_stats() -> MemoryStats {
+  MemoryStats result{
+      .nodes = 1 + 4 * children.size(),
+      .leaves = 1 + 3 * children.size(),
+      .bytes = sizeof(Qnode) + sizeof(Qsubdivision) * children.size(),
+  };
+  auto count_class = [&result](const auto &c) {
+    using Slot = typename std::decay_t<decltype(c.slots)>::value_type;
+    result.entry_slots += c.slots.size() * std::tuple_size_v<Slot>;
+    result.free_slots += c.free.size() * std::tuple_size_v<Slot>;
+    result.bytes += c.slots.size() * sizeof(Slot) +
+                    c.free.capacity() * sizeof(uint32_t);
+  };
+  std::apply([&](const auto &...c) { (count_class(c), ...); }, slots.classes);
+  for (const auto &overflow : overflows) {
+    result.entry_slots += overflow.capacity();
+    result.bytes += overflow.capacity() * sizeof(Entry);
+  }
+  for (const uint32_t ptr : free_overflows) {
+    result.free_slots += overflows[ptr].capacity();
+  }
+  result.bytes += overflows.size() * sizeof(overflows.front()) +
+                  free_overflows.capacity() * sizeof(uint32_t);
+
+  std::vector<Qnode> stack{root};
+  while (not stack.empty()) {
+    const Qnode node = stack.back();
+    stack.pop_back();
+    if (node.is_leaf()) {
+      result.entries += node.size;
+    } else {
+      const auto &nodes = child_nodes(node);
+      stack.insert(stack.end(), nodes.begin(), nodes.end());
+    }
+  }
+  return result;
+}
+
+using Qtree = BasicQtree<float>;
+using Qbound = BasicQbound<float>;
+using IQtree = BasicQtree<std::int32_t>;
+using IQbound = BasicQbound<std::int32_t>;
+// 16-bit leaf entries, for boards where rects stay within 32767 units of the
+// leaves they are stored in, see CollisionIndex::Quadtree16
+using IQtree16 = BasicQtree<std::int32_t, true>;
+
 } // namespace qtree
@@ -2,7 +2,12 @@
 
 #include "defines.h"
 
+#include <cmath>
+#include <cstdint>
+#include <memory_resource>
 #include <ostream>
+#include <type_traits>
+#include <vector>
 
 #if __has_include("raylib.h")
 #include "raylib.h"
@@ -13,71 +18,138 @@ constexpr auto ORIENTATON_MASK = 0b10;
 constexpr auto HORIZONTAL = 0b00;
 constexpr auto VERTICAL = 0b10;
 
-struct Point {
-  float x;
-  float y;
+// Geometry is templated on the coordinate type `T`. `float` is the default used
+// throughout the engine, integral types give exact, platform independent
+// overlap tests on pixel grids, or on fixed point grids once scaled
+template <typename T> struct BasicPoint {
+  T x;
+  T y;
 
-  constexpr auto center() const -> Point {
-    return Point{
+  constexpr auto center() const -> BasicPoint {
+    return BasicPoint{
         .x = x / 2,
         .y = y / 2,
     };
   }
 
+  friend auto operator==(const BasicPoint &lhs, const BasicPoint &rhs)
+      -> bool = default;
+  friend auto operator<<(std::ostream &os, const BasicPoint &v)
+      -> std::ostream & {
+    return os << "Point{.x = " << v.x << ", .y = " << v.y << "}";
+  }
+
 #ifdef HAS_RAYLIB
-  [[nodiscard]] constexpr auto raylib() const -> Vector2 { return {x, y}; }
+  [[nodiscard]] constexpr auto raylib() const -> Vector2 {
+    return {static_cast<float>(x), static_cast<float>(y)};
+  }
 #endif
 };
 
-struct Rect {
-  float lft;
-  float top;
-  float rgt;
-  float bot;
-
-  constexpr auto w() const -> float { return rgt - lft; }
-  constexpr auto h() const -> float { return bot - top; }
-  constexpr auto tl() const -> Point { return {lft, top}; }
-  constexpr auto tr() const -> Point { return {rgt, top}; }
-  constexpr auto bl() const -> Point { return {lft, bot}; }
-  constexpr auto br() const -> Point { return {rgt, bot}; }
-  constexpr auto area() const -> float { return w() * h(); }
-
-  constexpr auto center() const -> Point {
+template <typename T> struct BasicRect {
+  T lft;
+  T top;
+  T rgt;
+  T bot;
+
+  constexpr auto w() const -> T { return rgt - lft; }
+  constexpr auto h() const -> T { return bot - top; }
+  constexpr auto tl() const -> BasicPoint<T> { return {lft, top}; }
+  constexpr auto tr() const -> BasicPoint<T> { return {rgt, top}; }
+  constexpr auto bl() const -> BasicPoint<T> { return {lft, bot}; }
+  constexpr auto br() const -> BasicPoint<T> { return {rgt, bot}; }
+  constexpr auto area() const -> T { return w() * h(); }
+
+  constexpr auto center() const -> BasicPoint<T> {
     return {lft + w() / 2, top + h() / 2};
   }
 
-  constexpr auto is_point_inside(Point point) const -> bool {
+  constexpr auto is_point_inside(BasicPoint<T> point) const -> bool {
     return lft < point.x && point.x < rgt && top < point.y && point.y < bot;
   }
 
-  constexpr auto does_overlap(const Rect &o) const -> bool {
+  constexpr auto does_overlap(const BasicRect &o) const -> bool {
     return o.rgt > lft && rgt > o.lft && o.bot > top && bot > o.top;
   }
 
-  friend auto operator==(const Rect &lhs, const Rect &rhs) -> bool;
-  friend auto operator<<(std::ostream &os, const Rect &r) -> std::ostream &;
+  friend auto operator==(const BasicRect &lhs, const BasicRect &rhs)
+      -> bool = default;
+  friend auto operator<<(std::ostream &os, const BasicRect &r)
+      -> std::ostream & {
+    return os << "Rect{.lft = " << r.lft << ", .top = " << r.top
+              << ", .rgt = " << r.rgt << ", .bot = " << r.bot << "}";
+  }
 
 #ifdef HAS_RAYLIB
   [[nodiscard]] constexpr auto raylib() const -> Rectangle {
-    return {lft, top, w(), h()};
+    return {static_cast<float>(lft), static_cast<float>(top),
+            static_cast<float>(w()), static_cast<float>(h())};
   }
 #endif
 };
 
-using Bounds = std::vector<Rect>;
+using Point = BasicPoint<float>;
+using Rect = BasicRect<float>;
+using IPoint = BasicPoint<std::int32_t>;
+using IRect = BasicRect<std::int32_t>;
 
-auto operator==(const Point &lhs, const Point &rhs) -> bool;
-auto operator<<(std::ostream &os, const Point &v) -> std::ostream &;
+using Bounds = std::pmr::vector<Rect>;
 
 auto operator<<(std::ostream &os, const Bounds &b) -> std::ostream &;
 
-constexpr auto operator+(const Point &lhs, const Point &rhs) -> Point {
+template <typename T>
+constexpr auto operator+(const BasicPoint<T> &lhs, const BasicPoint<T> &rhs)
+    -> BasicPoint<T> {
   return {lhs.x + rhs.x, lhs.y + rhs.y};
 }
-constexpr auto operator-(const Point &lhs, const Point &rhs) -> Point {
+template <typename T>
+constexpr auto operator-(const BasicPoint<T> &lhs, const BasicPoint<T> &rhs)
+    -> BasicPoint<T> {
   return {lhs.x - rhs.x, lhs.y - rhs.y};
 }
-constexpr auto operator*(const Point &lhs, float scalar) -> Point {
+template <typename T>
+constexpr auto operator*(const BasicPoint<T> &lhs,
+                         std::type_identity_t<T> scalar) -> BasicPoint<T> {
   return {lhs.x * scalar, lhs.y * scalar};
 }
+
+// Converts a floating point coordinate to `T`, rounding to the nearest grid
+// point when `T` is integral
+template <typename T, typename F>
+  requires std::is_floating_point_v<F>
+inline auto coord_cast(F v) -> T {
+  if constexpr (std::is_integral_v<T>) {
+    return static_cast<T>(std::llround(v));
+  } else {
+    return static_cast<T>(v);
+  }
+}
+
+template <typename T, typename F>
+inline auto coord_cast(BasicPoint<F> p) -> BasicPoint<T> {
+  return {coord_cast<T>(p.x), coord_cast<T>(p.y)};
+}
+
+// Rounds `p` to the grid of `T`, a no-op for floating point `T`
+template <typename T> inline auto snap(Point p) -> Point {
+  if constexpr (std::is_integral_v<T>) {
+    return {std::round(p.x), std::round(p.y)};
+  } else {
+    return p;
+  }
+}
+
+// Smallest rect on the grid of `T` that covers `r`, so that overlap tests on
+// it never miss an overlap of `r`
+template <typename T> inline auto covering(const Rect &r) -> BasicRect<T> {
+  if constexpr (std::is_integral_v<T>) {
+    return {
+        static_cast<T>(std::floor(r.lft)),
+        static_cast<T>(std::floor(r.top)),
+        static_cast<T>(std::ceil(r.rgt)),
+        static_cast<T>(std::ceil(r.bot)),
+    };
+  } else {
+    return {r.lft, r.top, r.rgt, r.bot};
+  }
+}
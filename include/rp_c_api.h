@@ -1,51 +1,235 @@
-#if 0
 #ifndef RP_C_API_H
 #define RP_C_API_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct {
-    float x, y, w, h;
+    float lft, top, rgt, bot;
 } RpRect;
 
 typedef struct {
-    int src, dst;
+    size_t src, dst;
 } RpIndexPair;
 
 typedef struct {
     float x, y;
 } RpPosition;
 
+/* Orientations of placed polygons, see rp_get_orientations() */
+#define RP_HORIZONTAL 0
+#define RP_VERTICAL 2
+
+typedef struct {
+    size_t rect_intersects;
+    size_t point_intersects;
+    size_t nodes_visited;
+    size_t leaf_entries_tested;
+    size_t overflow_spills;
+    size_t closest_isect;
+    size_t probed;
+    size_t erased;
+} RpStats;
+
+typedef struct {
+    size_t probed, erased;
+} RpGroupStats;
+
 /*
- * Packs the rectangles into the smallest possible area.
- * @param out_positions The output positions of the rectangles.
- * @param rects The rectangles to pack.
+ * Opaque placement context. Scratch memory of a call is kept and reused by
+ * the following calls. A context must not be used by two threads at once.
+ */
+typedef struct RpContext RpContext;
+
+/*
+ * Creates a placement context.
+ * @return The new context. NULL if an error occurred.
+ */
+RpContext* rp_context_create(void);
+
+/*
+ * Destroys a context created with rp_context_create(). NULL is ignored.
+ */
+void rp_context_destroy(RpContext* ctx);
+
+/*
+ * Switches the following placements on ctx to integer coordinates. Polygons
+ * then only move by whole units and overlap tests are exact, so inputs on a
+ * pixel grid stay on it. Spirals are still computed in float, so layouts may
+ * differ between platforms whose libm rounds differently.
+ * @param ctx The context to configure.
+ * @param enabled 1 for integer coordinates, 0 for float (the default). While
+ * enabled, rp_place fails for rects or boards outside the int32 range.
+ */
+void rp_context_set_int_coordinates(RpContext* ctx, int enabled);
+
+/*
+ * Switches the following placements on ctx to the frontier engine. Polygons
+ * then go by their bounding box into the free space of their slice, which is
+ * much faster on inputs made of rectangles, but leaves the space around
+ * polygons that are not rectangles empty. Growth does not apply to it.
+ * @param ctx The context to configure.
+ * @param enabled 1 for the frontier engine, 0 for the spiral engine (the
+ * default).
+ */
+void rp_context_set_frontier(RpContext* ctx, int enabled);
+
+/*
+ * Lets the following placements on ctx grow the circle while polygons are left
+ * over. Placed polygons keep their positions, only the remaining ones are tried
+ * on the new outer part of their spirals.
+ * @param ctx The context to configure.
+ * @param max_growths The number of times the circle may grow, 0 (the default)
+ * to never grow it.
+ * @param factor How much the radius grows each time, finite and greater than
+ * 1. Otherwise rp_place fails while max_growths is not 0.
+ */
+void rp_context_set_growth(RpContext* ctx, size_t max_growths, float factor);
+
+/*
+ * Lets the following placements on ctx pull polygons toward the center of
+ * their group after placing them, in small steps that never make them overlap.
+ * Only applies to the spiral engine.
+ * @param ctx The context to configure.
+ * @param max_rounds The most steps any polygon takes, 0 (the default) for no
+ * compaction.
+ * @param max_ms The most milliseconds compaction may take, 0 for no limit.
+ * Layouts then depend on the speed of the machine.
+ */
+void rp_context_set_compaction(RpContext* ctx, size_t max_rounds,
+                               double max_ms);
+
+/*
+ * Lets the following placements on ctx turn polygons by 90 degrees where they
+ * do not fit as given, see rp_get_orientations(). These placements are not
+ * cached. Only applies to the spiral engine.
+ * @param ctx The context to configure.
+ * @param enabled 1 to turn polygons, 0 to keep them as given (the default).
+ */
+void rp_context_set_rotation(RpContext* ctx, int enabled);
+
+/*
+ * Sets the number of threads the following placements on ctx place the
+ * sub-clouds of nested groups on, that is of index pairs whose children have
+ * children of their own. Layouts do not depend on it.
+ * @param ctx The context to configure.
+ * @param threads The most threads to use, 0 (the default) for one per core.
+ */
+void rp_context_set_threads(RpContext* ctx, size_t threads);
+
+/*
+ * Keeps the layouts of the following placements on ctx, and answers jobs seen
+ * before with the same settings without placing them again, see
+ * include/layout_cache.h. Replaces the cache set before, if any.
+ * @param ctx The context to configure.
+ * @param capacity The number of layouts kept in memory. 0 to turn the cache
+ * off, path is then ignored.
+ * @param path A file to keep layouts in across runs, or NULL for memory only.
+ * It is created if missing, and can only be used by one context at a time.
+ * @return 0 on success. -1 if path could not be used, layouts are then only
+ * kept in memory.
+ */
+int rp_context_set_cache(RpContext* ctx, size_t capacity, const char* path);
+
+/*
+ * Gets how many placements on ctx the cache has answered, and how many it
+ * had to place, since it was set.
+ * @param ctx The context of the placements.
+ * @param out_hits Receives the number of placements answered from the cache.
+ * @param out_misses Receives the number of placements run.
+ */
+void rp_get_cache_stats(const RpContext* ctx,
+                        size_t* out_hits,
+                        size_t* out_misses);
+
+/*
+ * Places polygons made of rectangles in a circle centered on the board.
+ * All buffers are owned by the caller and are not retained.
+ * @param ctx The context to run the placement in.
+ * @param out_positions Receives the offset of every polygon, n_polygons long.
+ * @param rects The rectangles of all polygons, back to back.
  * @param n_rects The number of rectangles.
- * @param indices The parent-child indices.
+ * @param offsets Polygon i is rects[offsets[i]] .. rects[offsets[i + 1] - 1],
+ * n_polygons + 1 long.
+ * @param n_polygons The number of polygons.
+ * @param indices The group-child indices.
  * @param n_indices The number of indices.
- * @return The number of packed rectangles. -1 if an error occurred.
+ * @param tolerances The simplification tolerance of every polygon,
+ * n_polygons long. NULL for no simplification.
+ * @param board_dims The width and height of the board.
+ * @return The number of placed polygons. -1 if an error occurred.
  * For error details, call rp_get_error().
  */
-int rp_pack_rects(RpPosition* out_positions,
-                  RpRect* rects,
-                  int n_rects,
-                  RpIndexPair* indices,
-                  int n_indices,
-                  RpPosition center);
+int rp_place(RpContext* ctx,
+             RpPosition* out_positions,
+             const RpRect* rects,
+             size_t n_rects,
+             const size_t* offsets,
+             size_t n_polygons,
+             const RpIndexPair* indices,
+             size_t n_indices,
+             const float* tolerances,
+             RpPosition board_dims);
+
+/*
+ * Gets the hot path counters of the last successful rp_place() on ctx.
+ * Counters are only collected when the library is built with RP_STATS,
+ * otherwise they are all 0, see rp_stats_enabled().
+ * @param ctx The context of the placement.
+ * @param out_stats Receives the counters summed over all groups.
+ * @param out_groups Receives the counters of the first n_groups groups.
+ * May be NULL.
+ * @param n_groups The length of out_groups.
+ * @return The number of groups of the last placement, 0 unless built with
+ * RP_STATS.
+ */
+size_t rp_get_stats(const RpContext* ctx,
+                    RpStats* out_stats,
+                    RpGroupStats* out_groups,
+                    size_t n_groups);
+
+/*
+ * Gets the orientation of every polygon of the last successful rp_place() on
+ * ctx. A polygon placed as given is RP_HORIZONTAL. An RP_VERTICAL polygon is
+ * turned by 90 degrees about the top left corner (lft, top) of its bounding
+ * box, so that its point (x, y) goes to (lft + bot - y, top + x - lft), and
+ * then moved by its position.
+ * @param ctx The context of the placement.
+ * @param out_orientations Receives the orientations of the first n_polygons
+ * polygons.
+ * @param n_polygons The length of out_orientations.
+ * @return The number of polygons of the last placement.
+ */
+size_t rp_get_orientations(const RpContext* ctx,
+                           int* out_orientations,
+                           size_t n_polygons);
+
+int rp_stats_enabled(void);
+
+/*
+ * Writes the phase trace events recorded so far, by all contexts, to path in
+ * the Chrome trace format, and drops them, so that the next call only writes
+ * later events. At most the last 2^20 events are kept between calls. Events
+ * are only recorded when the library is built with RP_TRACE, otherwise the
+ * trace is empty.
+ * @param path The file to write.
+ * @return 0 on success. -1 if an error occurred.
+ */
+int rp_trace_write(const char* path);
 
 /*
- * Gets the last error message.
+ * Gets the last error message of the calling thread.
  * @return The last error message.
  */
-const char* rp_get_error();
+const char* rp_get_error(void);
 
-int rp_version();
+int rp_version(void);
 
 #ifdef __cplusplus
 } // extern "C"
 #endif
 
 #endif // RP_C_API_H
-#endif // 0
@@ -0,0 +1,401 @@
+#pragma once
+
+#include "api.h"
+#include "cloud.h"
+#include "defines.h"
+#include "hierarchy.h"
+#include "polygon.h"
+#include "rect.h"
+#include "spiral.h"
+
+#include <algorithm>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <utility>
+
+// What PlacementSession::update did
+struct SessionUpdate {
+  int number_placed = 0;
+  std::size_t groups_placed = 0; // Groups re-placed by this update
+  bool full = false;             // Everything was placed from scratch
+};
+
+// A placement kept alive between edits, for callers that re-place on every
+// change. The first update places everything like `place` would. After that,
+// edits only mark the groups they touch, and update re-places those groups
+// within the slices and spirals they already had, around everything else.
+//
+// Groups are the polygons that are the `src` of an index pair, as in `place`.
+// Adding or removing a group changes how the circle is split and places
+// everything again, as does a re-placed group that no longer fits where it
+// used to. Polygon ids are stable, removed ones are not reused. Sessions always
+// use the spiral engine, the quadtree and float coordinates, and never turn,
+// compact or grow, see `supports`.
+//
+// While index pairs nest, see hierarchy.h, every update places everything
+// with make_nested_cloud, as `place` does
+class PlacementSession {
+public:
+  // `opts` must be supported
+  explicit PlacementSession(const PlaceJob &job, const CloudOptions &opts = {});
+
+  // Whether the first update places as `place` would with `opts`
+  static auto supports(const CloudOptions &opts) -> bool {
+    return opts.engine == Engine::Spiral &&
+           opts.index == CollisionIndex::Quadtree && not opts.rotate &&
+           opts.compaction_rounds == 0 && opts.max_growths == 0 &&
+           opts.coordinates == Coordinates::Float;
+  }
+  PlacementSession(const PlacementSession &) = delete;
+  auto operator=(const PlacementSession &) = delete;
+
+  // Unplaced until it is part of a group
+  auto add_polygon(std::span<const Rect> rects, float tolerance)
+      -> std::size_t;
+  // Also removes the index pairs it is part of
+  void remove_polygon(std::size_t i);
+  void resize_polygon(std::size_t i, std::span<const Rect> rects,
+                      float tolerance);
+  void add_index_pair(IndexPair pair);
+  void remove_index_pair(IndexPair pair);
+
+  auto update() -> SessionUpdate;
+
+  auto size() const -> std::size_t { return inputs_.size(); }
+  // Offset of polygon `i` from its input rects, as `place` writes it
+  auto position(std::size_t i) const -> Point;
+  auto is_placed(std::size_t i) const -> bool { return placed_[i]; }
+  auto number_placed() const -> int {
+    return _int(std::ranges::count(placed_, true));
+  }
+  auto radius() const -> float { return radius_; }
+
+private:
+  struct Input {
+    Bounds rects;
+    float tolerance;
+    bool alive = true;
+  };
+  struct Group {
+    std::size_t root;
+    std::pmr::vector<std::size_t> children;
+    std::pmr::vector<Point> pristine; // The spiral before anything was placed
+    Spiral spiral;
+    Point center{};
+    bool dirty = false;
+    bool fits = false; // Every member was placed the last time
+  };
+
+  auto make_working(std::size_t i) -> PolygonE;
+  auto nested() const -> bool;
+  auto group_roots() const -> std::pmr::vector<std::size_t>;
+  auto group_of(std::size_t root) -> Group *;
+  void collect_children(Group &g);
+  void mark_dirty(std::size_t root);
+  void insert(std::size_t i);
+  void erase(std::size_t i);
+  auto all_placed(const Group &g) const -> bool;
+  auto replace_group(std::size_t gi) -> bool;
+  auto relayout() -> SessionUpdate;
+
+  std::pmr::unsynchronized_pool_resource pool_;
+  CloudOptions opts_;
+  Point board_dims_;
+  std::pmr::vector<Input> inputs_{&pool_};
+  std::pmr::vector<PolygonE> polys_{&pool_}; // Simplified, where last tried
+  std::pmr::vector<bool> placed_ = std::pmr::vector<bool>(&pool_);
+  std::pmr::vector<uint32_t> bvhs_{&pool_}; // As returned by Placer::insert
+  std::pmr::vector<IndexPair> pairs_{&pool_};
+  std::pmr::vector<Group> groups_{&pool_}; // By root
+  std::optional<BasicPlacer<float>> placer_; // None while pairs nest
+  float radius_ = 0.F;
+  bool full_ = true; // The next update places everything
+};
+
+inline PlacementSession::PlacementSession(const PlaceJob &job,
+                                          const CloudOptions &opts)
+    : opts_{opts}, board_dims_{job.board_dims} {
+  CUSTOM_ASSERT(supports(opts));
+  for (std::size_t i = 0; i < job.size(); ++i) {
+    add_polygon(job.polygon(i), job.tolerances[i]);
+  }
+  pairs_.assign(job.indices.begin(), job.indices.end());
+}
+
+// As `place_polygons` prepares them
+inline auto PlacementSession::make_working(std::size_t i) -> PolygonE {
+  const Input &input = inputs_[i];
+  PolygonE result{Polygon{Bounds(input.rects, &pool_)}};
+  result.simplify(input.tolerance);
+  return result;
+}
+
+inline auto PlacementSession::add_polygon(std::span<const Rect> rects,
+                                          float tolerance) -> std::size_t {
+  CUSTOM_ASSERT(not rects.empty());
+  inputs_.push_back({Bounds(rects.begin(), rects.end(), &pool_), tolerance});
+  polys_.push_back(make_working(inputs_.size() - 1));
+  placed_.push_back(false);
+  bvhs_.push_back(qtree::no_id);
+  return inputs_.size() - 1;
+}
+
+inline void PlacementSession::remove_polygon(std::size_t i) {
+  CUSTOM_ASSERT(i < size() && inputs_[i].alive);
+  erase(i);
+  inputs_[i].alive = false;
+  std::erase_if(pairs_, [this, i](IndexPair p) {
+    if (p.dst == i) {
+      mark_dirty(p.src);
+    }
+    return p.src == i || p.dst == i;
+  });
+}
+
+inline void PlacementSession::resize_polygon(
+    std::size_t i, std::span<const Rect> rects, float tolerance) {
+  CUSTOM_ASSERT(i < size() && inputs_[i].alive && not rects.empty());
+  erase(i);
+  inputs_[i] = {Bounds(rects.begin(), rects.end(), &pool_), tolerance};
+  polys_[i] = make_working(i);
+  for (IndexPair p : pairs_) {
+    if (p.src == i || p.dst == i) {
+      mark_dirty(p.src);
+    }
+  }
+}
+
+inline void PlacementSession::add_index_pair(IndexPair pair) {
+  CUSTOM_ASSERT(pair.src < size() && inputs_[pair.src].alive);
+  CUSTOM_ASSERT(pair.dst < size() && inputs_[pair.dst].alive);
+  CUSTOM_ASSERT(pair.src != pair.dst);
+  pairs_.push_back(pair);
+  mark_dirty(pair.src);
+}
+
+inline void PlacementSession::remove_index_pair(IndexPair pair) {
+  const auto it = std::ranges::find_if(pairs_, [pair](IndexPair p) {
+    return p.src == pair.src && p.dst == pair.dst;
+  });
+  CUSTOM_ASSERT(it != pairs_.end());
+  pairs_.erase(it);
+  mark_dirty(pair.src);
+  // So that re-placing the group leaves `pair.dst` where it is
+  if (Group *g = group_of(pair.src)) {
+    collect_children(*g);
+  }
+  // A dst that is still a root or a child of some group is re-placed by it
+  bool kept = false;
+  for (IndexPair p : pairs_) {
+    if (p.src == pair.dst || p.dst == pair.dst) {
+      mark_dirty(p.src);
+      kept = true;
+    }
+  }
+  if (not kept) {
+    erase(pair.dst);
+  }
+}
+
+inline auto PlacementSession::position(std::size_t i) const -> Point {
+  if (not inputs_[i].alive) {
+    return {};
+  }
+  return polys_[i].rects.front().tl() - inputs_[i].rects.front().tl();
+}
+
+// Whether the dst of some pair is a group of its own
+inline auto PlacementSession::nested() const -> bool {
+  const auto roots = group_roots();
+  return std::ranges::any_of(pairs_, [&roots](IndexPair p) {
+    return std::ranges::binary_search(roots, p.dst);
+  });
+}
+
+inline auto PlacementSession::group_roots() const
+    -> std::pmr::vector<std::size_t> {
+  std::pmr::vector<std::size_t> result(pairs_.size(),
+                                       pairs_.get_allocator().resource());
+  std::ranges::transform(pairs_, result.begin(), &IndexPair::src);
+  std::ranges::sort(result);
+  result.erase(std::ranges::unique(result).begin(), result.end());
+  return result;
+}
+
+inline auto PlacementSession::group_of(std::size_t root) -> Group * {
+  const auto it = std::ranges::lower_bound(groups_, root, _lt_, &Group::root);
+  return it != groups_.end() && it->root == root ? &*it : nullptr;
+}
+
+// In the order of the index pairs, as make_group_index lists them
+inline void PlacementSession::collect_children(Group &g) {
+  g.children.clear();
+  for (IndexPair p : pairs_) {
+    if (p.src == g.root) {
+      g.children.push_back(p.dst);
+    }
+  }
+  if (opts_.sort_children_by_area) {
+    std::ranges::stable_sort(g.children, _gt_, [this](std::size_t dst) {
+      return polys_[dst].area();
+    });
+  }
+}
+
+// A root that is no group yet is picked up by the relayout its group causes
+inline void PlacementSession::mark_dirty(std::size_t root) {
+  if (Group *g = group_of(root)) {
+    g->dirty = true;
+  }
+}
+
+inline void PlacementSession::insert(std::size_t i) {
+  bvhs_[i] = placer_->insert(polys_[i]);
+  placed_[i] = true;
+}
+
+inline void PlacementSession::erase(std::size_t i) {
+  if (placed_[i] && placer_) {
+    placer_->erase(polys_[i], bvhs_[i]);
+  }
+  placed_[i] = false;
+}
+
+inline auto PlacementSession::all_placed(const Group &g) const -> bool {
+  return placed_[g.root] &&
+         std::ranges::all_of(g.children, [this](std::size_t i) -> bool {
+           return placed_[i];
+         });
+}
+
+// Takes the group out and places it again from the start of its spiral, with
+// both phases of make_cloud. False if it fitted before and no longer does
+inline auto PlacementSession::replace_group(std::size_t gi) -> bool {
+  Group &g = groups_[gi];
+  erase(g.root);
+  for (std::size_t dst : g.children) {
+    erase(dst);
+  }
+  collect_children(g);
+  g.spiral.assign(g.pristine);
+  g.center = {};
+  g.dirty = false;
+
+  if (const auto at = placer_->place_group(gi, g.spiral, polys_[g.root])) {
+    insert(g.root);
+    g.center = *at;
+  }
+  placer_->blockers.clear();
+  for (std::size_t dst : g.children) {
+    if (placer_->place_child(gi, g.spiral, g.center, polys_[dst])) {
+      insert(dst);
+    }
+  }
+  const bool fitted = std::exchange(g.fits, all_placed(g));
+  return g.fits || not fitted;
+}
+
+inline auto PlacementSession::relayout() -> SessionUpdate {
+  RP_TRACE_SCOPE("session relayout");
+  full_ = false;
+  placer_.reset();
+  std::fill(placed_.begin(), placed_.end(), false);
+  for (std::size_t i = 0; i < size(); ++i) {
+    if (inputs_[i].alive) {
+      polys_[i] = make_working(i);
+    }
+  }
+
+  groups_.clear();
+  radius_ = 0.F;
+  if (nested()) {
+    const Cloud cloud =
+        make_nested_cloud(polys_, pairs_, board_dims_, opts_, &pool_);
+    placed_.assign(cloud.placed.begin(), cloud.placed.end());
+    radius_ = cloud.radius;
+    return {
+        .number_placed = number_placed(),
+        .groups_placed = group_roots().size(),
+        .full = true,
+    };
+  }
+
+  std::pmr::vector<float> areas(&pool_);
+  for (std::size_t root : group_roots()) {
+    Group &g = groups_.emplace_back(Group{
+        .root = root,
+        .children = std::pmr::vector<std::size_t>(&pool_),
+        .pristine = std::pmr::vector<Point>(&pool_),
+        .spiral = Spiral{std::pmr::vector<Point>(&pool_)},
+    });
+    collect_children(g);
+    // Summed before sorting, as in make_group_index
+    float &area = areas.emplace_back(polys_[root].area());
+    for (IndexPair p : pairs_) {
+      if (p.src == root) {
+        area += polys_[p.dst].area();
+      }
+    }
+  }
+  if (groups_.empty()) {
+    return {.full = true};
+  }
+
+  radius_ = std::sqrt(accumulate(areas, 0.F) / M_PI);
+  const Point center = board_dims_.center();
+  const auto slices = Circ{center, radius_}.split(areas, &pool_);
+  for (std::size_t gi = 0; gi < groups_.size(); ++gi) {
+    Group &g = groups_[gi];
+    g.spiral = spiral(slices[gi], &pool_);
+    g.pristine.assign(g.spiral.data.begin(), g.spiral.data.end());
+  }
+  placer_.emplace(cloud_bounds(center, radius_, board_dims_), groups_.size(),
+                  opts_.bvh_min_rects, &pool_);
+
+  // Every root first, then the children group by group, as in make_cloud
+  for (std::size_t gi = 0; gi < groups_.size(); ++gi) {
+    Group &g = groups_[gi];
+    if (const auto at = placer_->place_group(gi, g.spiral, polys_[g.root])) {
+      insert(g.root);
+      g.center = *at;
+    }
+  }
+  for (std::size_t gi = 0; gi < groups_.size(); ++gi) {
+    Group &g = groups_[gi];
+    placer_->blockers.clear();
+    for (std::size_t dst : g.children) {
+      if (placer_->place_child(gi, g.spiral, g.center, polys_[dst])) {
+        insert(dst);
+      }
+    }
+    g.fits = all_placed(g);
+  }
+  return {
+      .number_placed = number_placed(),
+      .groups_placed = groups_.size(),
+      .full = true,
+  };
+}
+
+inline auto PlacementSession::update() -> SessionUpdate {
+  const auto roots = group_roots();
+  if (full_ || nested() ||
+      not std::ranges::equal(roots, groups_, {}, {}, &Group::root)) {
+    return relayout();
+  }
+
+  RP_TRACE_SCOPE("session update");
+  SessionUpdate result;
+  for (std::size_t gi = 0; gi < groups_.size(); ++gi) {
+    if (not groups_[gi].dirty) {
+      continue;
+    }
+    ++result.groups_placed;
+    if (not replace_group(gi)) {
+      return relayout();
+    }
+  }
+  result.number_placed = number_placed();
+  return result;
+}
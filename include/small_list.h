@@ -1,13 +1,17 @@
 #pragma once
 
+#include "defines.h"
+
+#include <memory_resource>
 #include <span>
 #include <type_traits>
 #include <vector>
 
 template <typename T, size_t N> struct SmallList {
   std::span<T, N> values;
-  std::vector<T> overflow;
+  std::pmr::vector<T> overflow;
   std::size_t size = 0;
+  std::size_t *spills = nullptr; // Counts pushes to `overflow` under RP_STATS
 
   auto is_empty() -> bool { return size == 0; }
 
@@ -15,6 +19,7 @@ template <typename T, size_t N> struct SmallList {
     if (size < N) {
       values[size++] = value;
     } else {
+      RP_STAT(spills && ++*spills);
       overflow.push_back(value);
       size++;
     }
@@ -24,13 +29,14 @@ template <typename T, size_t N> struct SmallList {
     if (size < N) {
       values[size++] = T{std::forward<Args>(args)...};
     } else {
+      RP_STAT(spills && ++*spills);
       overflow.emplace_back(std::forward<Args>(args)...);
       size++;
     }
   }
 
   auto pop_back() -> T {
-    if (size < N) {
+    if (size <= N) {
       return values[--size];
     } else {
       auto value = std::move(overflow.back());
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "defines.h"
 
 #include "circ.h"
@@ -31,11 +33,21 @@ inline auto centroid(std::span<const Point> ps) -> Point {
   };
 }
 
+// Points to probe, in order. Those before `slow` are erased: covered points are
+// swapped there, so the rest stays contiguous.
+//
+// Children are put on the points facing the center of their group, see
+// `aim`. The unit vector from each point toward it is kept in `dir_x` and
+// `dir_y`, next to `data` and swapped along with it. It is worked out the
+// first time a point is probed and reused by every later child of the group
 struct Spiral {
-  using iterator = std::vector<Point>::iterator;
+  using iterator = std::pmr::vector<Point>::iterator;
 
-  std::vector<Point> data;
+  std::pmr::vector<Point> data;
   iterator slow = std::begin(data);
+  std::pmr::vector<float> dir_x{data.get_allocator().resource()};
+  std::pmr::vector<float> dir_y{data.get_allocator().resource()};
+  std::optional<Point> target = std::nullopt; // None until `aim`
 
   inline auto begin() { return slow; }
   inline auto end() { return std::end(data); }
@@ -44,11 +56,55 @@ struct Spiral {
 
   inline auto size() -> std::size_t { return std::distance(begin(), end()); }
   inline auto erase(decltype(data)::iterator it) {
+    if (target) {
+      const auto i = std::distance(std::begin(data), it);
+      const auto j = std::distance(std::begin(data), slow);
+      std::swap(dir_x[i], dir_x[j]);
+      std::swap(dir_y[i], dir_y[j]);
+    }
     std::iter_swap(it, slow++);
   };
+  // Appends points after the existing ones, which stay erased or not
+  inline void append(std::span<const Point> points) {
+    const auto erased = std::distance(std::begin(data), slow);
+    data.insert(std::end(data), points.begin(), points.end());
+    slow = std::begin(data) + erased;
+    if (target) {
+      dir_x.resize(data.size(), nanf(""));
+      dir_y.resize(data.size(), nanf(""));
+    }
+  }
+  // Replaces the points, none of them erased
+  inline void assign(std::span<const Point> points) {
+    data.assign(points.begin(), points.end());
+    slow = std::begin(data);
+    target.reset();
+  }
+
+  // Makes `direction` face `t`. Directions toward another target are dropped
+  inline void aim(Point t) {
+    if (target == t) {
+      return;
+    }
+    target = t;
+    dir_x.assign(data.size(), nanf(""));
+    dir_y.assign(data.size(), nanf(""));
+  }
+  // Unit vector from `*it` toward the target of `aim`
+  inline auto direction(iterator it) -> Point {
+    const auto i = std::distance(std::begin(data), it);
+    if (std::isnan(dir_x[i])) {
+      const float theta = edge_angle(*it, *target);
+      dir_x[i] = cosf(theta);
+      dir_y[i] = sinf(theta);
+    }
+    return {dir_x[i], dir_y[i]};
+  }
 };
 
-inline auto spiral(Slice slice) -> Spiral {
+inline auto spiral(Slice slice, std::pmr::memory_resource *mem =
+                                    std::pmr::get_default_resource())
+    -> Spiral {
   constexpr auto resolution = 20;
   constexpr auto padding_mult = 1.2F;
   constexpr auto padding_resolution = _int(resolution * padding_mult);
@@ -57,7 +113,7 @@ inline auto spiral(Slice slice) -> Spiral {
 
   auto points = slice.points<slice_res>();
   auto center = slice.centroid();
-  std::vector<Point> result;
+  std::pmr::vector<Point> result(mem);
   result.reserve(slice_res * (resolution + padding_resolution));
   auto t = .0F;
   for (int i = 0; i < resolution; ++i) {
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Hot path counters. They are only recorded when compiled with RP_STATS (see
+// RP_STAT in defines.h), otherwise they stay 0 and cost nothing
+
+struct QtreeStats {
+  std::size_t rect_intersects = 0;
+  std::size_t point_intersects = 0;
+  std::size_t nodes_visited = 0;       // By the two queries above
+  std::size_t leaf_entries_tested = 0; // By the two queries above
+  std::size_t overflow_spills = 0;     // Traversal stack pushes past the array
+};
+
+struct GroupStats {
+  std::size_t probed = 0; // Spiral points tried
+  std::size_t erased = 0; // Spiral points found covered and dropped
+};
+
+struct CloudStats {
+  QtreeStats qtree;
+  std::size_t closest_isect = 0;
+  std::size_t blocker_hits = 0; // Probes blocked by a cached blocker
+  std::pmr::vector<GroupStats> groups; // Empty unless RP_STATS
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#include <string>
+#endif
+
+// Phase level tracing. Scopes opened with RP_TRACE_SCOPE are recorded as
+// complete events and written out in the Chrome trace format, which
+// chrome://tracing and ui.perfetto.dev open. In WASM builds every scope is a
+// console.time / console.timeEnd pair instead. Unless RP_TRACE is defined the
+// scopes are not compiled at all
+//
+// The recorder keeps the last Recorder::capacity events, overwriting the
+// oldest ones as a ring, so that long-running processes stay bounded.
+// write_chrome_json drains it, a later call only writes what came after
+//
+//   RP_TRACE_SCOPE("split");
+//   RP_TRACE_SCOPE_ARG("child placement", src);
+//   trace::write_chrome_json("rp.trace.json");
+
+namespace trace {
+
+constexpr auto NO_ARG = std::numeric_limits<std::size_t>::max();
+
+struct Event {
+  const char *name; // Must be a string literal
+  std::size_t arg;  // NO_ARG when not given
+  double start_us;
+  double dur_us;
+  std::uint32_t tid;
+};
+
+struct Recorder {
+  std::mutex mutex;
+  std::size_t capacity = std::size_t{1} << 20; // Events kept, at least 1
+  // Once full, `next` is the oldest event, the one overwritten next
+  std::vector<Event> events;
+  std::size_t next = 0;
+  std::chrono::steady_clock::time_point epoch =
+      std::chrono::steady_clock::now();
+
+  void push(const Event &e) {
+    if (events.size() < capacity) {
+      events.push_back(e);
+      return;
+    }
+    events[next] = e;
+    next = (next + 1) % events.size();
+  }
+
+  // In order of completion
+  auto ordered() const -> std::vector<Event> {
+    std::vector<Event> result(events.begin() + next, events.end());
+    result.insert(result.end(), events.begin(), events.begin() + next);
+    return result;
+  }
+
+  void reset() {
+    events = {};
+    next = 0;
+  }
+};
+
+inline auto recorder() -> Recorder & {
+  static Recorder r;
+  return r;
+}
+
+// Small and stable, unlike hashes of std::thread::id
+inline auto thread_id() -> std::uint32_t {
+  static std::atomic<std::uint32_t> next = 0;
+  thread_local const std::uint32_t id = next++;
+  return id;
+}
+
+inline auto since_epoch_us(std::chrono::steady_clock::time_point t) -> double {
+  return std::chrono::duration<double, std::micro>(t - recorder().epoch)
+      .count();
+}
+
+class Scope {
+public:
+#ifdef __EMSCRIPTEN__
+  explicit Scope(const char *name, std::size_t arg = NO_ARG) : label{name} {
+    if (arg != NO_ARG) {
+      label += ' ' + std::to_string(arg);
+    }
+    EM_ASM({ console.time(UTF8ToString($0)); }, label.c_str());
+  }
+#else
+  explicit Scope(const char *name, std::size_t arg = NO_ARG)
+      : name{name}, arg{arg}, start{std::chrono::steady_clock::now()} {}
+#endif
+  ~Scope() {
+#ifdef __EMSCRIPTEN__
+    EM_ASM({ console.timeEnd(UTF8ToString($0)); }, label.c_str());
+#else
+    const auto end = std::chrono::steady_clock::now();
+    const double start_us = since_epoch_us(start);
+    Recorder &r = recorder();
+    const std::lock_guard lock{r.mutex};
+    r.push({name, arg, start_us, since_epoch_us(end) - start_us,
+            thread_id()});
+#endif
+  }
+  Scope(const Scope &) = delete;
+  auto operator=(const Scope &) -> Scope & = delete;
+
+private:
+#ifdef __EMSCRIPTEN__
+  std::string label;
+#else
+  const char *name;
+  std::size_t arg;
+  std::chrono::steady_clock::time_point start;
+#endif
+};
+
+// Events kept so far, in order of completion
+inline auto events() -> std::vector<Event> {
+  Recorder &r = recorder();
+  const std::lock_guard lock{r.mutex};
+  return r.ordered();
+}
+
+inline void clear() {
+  Recorder &r = recorder();
+  const std::lock_guard lock{r.mutex};
+  r.reset();
+}
+
+// Writes the events kept so far and removes them from the recorder
+inline void write_chrome_json(std::FILE *out) {
+  std::vector<Event> drained;
+  {
+    Recorder &r = recorder();
+    const std::lock_guard lock{r.mutex};
+    drained = r.ordered();
+    r.reset();
+  }
+  std::fputs("{\"traceEvents\":[", out);
+  const char *sep = "\n";
+  for (const Event &e : drained) {
+    std::fprintf(out,
+                 "%s{\"name\":\"%s\",\"cat\":\"rp\",\"ph\":\"X\",\"ts\":%.3f,"
+                 "\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+                 sep, e.name, e.start_us, e.dur_us, e.tid);
+    if (e.arg != NO_ARG) {
+      std::fprintf(out, ",\"args\":{\"group\":%zu}", e.arg);
+    }
+    std::fputs("}", out);
+    sep = ",\n";
+  }
+  std::fputs("\n]}\n", out);
+}
+
+// False if `path` could not be written
+inline auto write_chrome_json(const char *path) -> bool {
+  std::FILE *out = std::fopen(path, "w");
+  if (out == nullptr) {
+    return false;
+  }
+  write_chrome_json(out);
+  return std::fclose(out) == 0;
+}
+
+} // namespace trace
+
+#define RP_TRACE_CONCAT_(a, b) a##b
+#define RP_TRACE_CONCAT(a, b) RP_TRACE_CONCAT_(a, b)
+
+#ifdef RP_TRACE
+#define RP_TRACE_SCOPE(name)                                                   \
+  const trace::Scope RP_TRACE_CONCAT(rp_trace_scope_, __LINE__) { name }
+#define RP_TRACE_SCOPE_ARG(name, arg)                                          \
+  const trace::Scope RP_TRACE_CONCAT(rp_trace_scope_, __LINE__) { name, arg }
+#else
+#define RP_TRACE_SCOPE(name) ((void)0)
+#define RP_TRACE_SCOPE_ARG(name, arg) ((void)0)
+#endif
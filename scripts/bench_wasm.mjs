@@ -0,0 +1,71 @@
+// Headless comparison of rp_wasm and rp_wasm_mt on synthetic jobs.
+//
+//   emcmake cmake -S . -B build_em -DCMAKE_BUILD_TYPE=Release
+//   cmake --build build_em --target rp_wasm rp_wasm_mt -j`nproc`
+//   node scripts/bench_wasm.mjs build_em
+import { pathToFileURL } from "node:url";
+import { resolve } from "node:path";
+import { loadRp } from "./rp_loader.mjs";
+
+const dir = pathToFileURL(resolve(process.argv[2] ?? "build_em")).href;
+const runs = 5;
+
+// Same shapes as random_rectangle/random_index_pair_gen in rp_native.cpp
+function makeJob(nRects, nGroups, seed = 69420) {
+  let s = seed;
+  const rand = (lo, hi) => {
+    s = (Math.imul(s, 1664525) + 1013904223) >>> 0;
+    return lo + (s % (hi - lo + 1));
+  };
+  const rects = new Float32Array(nRects * 4);
+  const areas = [];
+  for (let i = 0; i < nRects; ++i) {
+    const w = rand(20, 50);
+    const h = Math.round((w * rand(20, 50)) / 100);
+    const lft = rand(0, 2400);
+    const top = rand(0, 1400);
+    areas.push([w * h, lft, top, w, h]);
+  }
+  areas.sort((a, b) => b[0] - a[0]);
+  areas.forEach(([, lft, top, w, h], i) =>
+    rects.set([lft, top, lft + w, top + h], i * 4)
+  );
+  const offsets = Uint32Array.from({ length: nRects + 1 }, (_, i) => i);
+  const indices = new Uint32Array((nRects - nGroups) * 2);
+  for (let i = nGroups; i < nRects; ++i) {
+    const src = i < 2 * nGroups ? i - nGroups : rand(0, nGroups - 1);
+    indices.set([src, i], (i - nGroups) * 2);
+  }
+  return { rects, offsets, indices, tolerances: new Float32Array(nRects) };
+}
+
+async function bench(threads) {
+  const { rp } = await loadRp(dir, { threads });
+  const placer = new rp.FlatPlacer();
+  for (const [nRects, nGroups] of [[500, 4], [2000, 8], [5000, 16]]) {
+    const job = makeJob(nRects, nGroups);
+    placer.resize(nRects, nRects, job.indices.length / 2);
+    placer.rects().set(job.rects);
+    placer.offsets().set(job.offsets);
+    placer.indices().set(job.indices);
+    placer.tolerances().set(job.tolerances);
+    let best = Infinity;
+    let placed = 0;
+    for (let r = 0; r < runs; ++r) {
+      const start = performance.now();
+      placed = placer.place(3200, 1800);
+      best = Math.min(best, performance.now() - start);
+    }
+    if (placed < 0) throw new Error(rp.get_error());
+    const variant = threads ? "rp_wasm_mt" : "rp_wasm   ";
+    console.log(
+      `${variant} rects=${nRects} groups=${nGroups} placed=${placed} ` +
+        `best=${best.toFixed(1)}ms`
+    );
+  }
+  placer.delete();
+}
+
+await bench(false);
+await bench(true);
+process.exit(0);
@@ -2,4 +2,7 @@
 
 cp build_em_release/rp_wasm.js ~/projs/skillcloud/src/lib/api/
 cp build_em_release/rp_wasm.wasm ~/projs/skillcloud/src/lib/api/
+cp build_em_release/rp_wasm_mt.js ~/projs/skillcloud/src/lib/api/
+cp build_em_release/rp_wasm_mt.wasm ~/projs/skillcloud/src/lib/api/
+cp scripts/rp_loader.mjs ~/projs/skillcloud/src/lib/api/
 cp build_em_release/rp.d.ts ~/projs/skillcloud/src/lib/types/
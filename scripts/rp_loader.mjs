@@ -0,0 +1,24 @@
+// Picks the fastest rp_wasm build the environment can run. The SIMD128 +
+// pthreads build (rp_wasm_mt) needs SharedArrayBuffer, which browsers only
+// expose on cross-origin isolated pages (COOP: same-origin, COEP: require-corp).
+
+// Smallest module using a v128 instruction, see wasm-feature-detect
+const SIMD_PROBE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1,
+  8, 0, 65, 0, 253, 15, 253, 98, 11,
+]);
+
+export function canUseThreads() {
+  return (
+    typeof SharedArrayBuffer !== "undefined" &&
+    globalThis.crossOriginIsolated !== false &&
+    WebAssembly.validate(SIMD_PROBE)
+  );
+}
+
+// dir: URL or path prefix of the directory holding rp_wasm{,_mt}.{js,wasm}
+export async function loadRp(dir = ".", { threads = canUseThreads() } = {}) {
+  const name = threads ? "rp_wasm_mt.js" : "rp_wasm.js";
+  const { default: factory } = await import(`${dir}/${name}`);
+  return { rp: await factory(), threads };
+}
@@ -1,59 +1,215 @@
-#if 0
-#include "defines.h"
+#include "rp_c_api.h"
 
-#include "cloud.h"
+#include "api.h"
+#include "counting_resource.h"
+#include "defines.h"
+#include "layout_cache.h"
 #include "rect.h"
-#include "rp_c_api.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <vector>
+
+// The C structs are passed to the engine as is, without copying
+static_assert(sizeof(RpRect) == sizeof(Rect) &&
+              offsetof(RpRect, lft) == offsetof(Rect, lft) &&
+              offsetof(RpRect, top) == offsetof(Rect, top) &&
+              offsetof(RpRect, rgt) == offsetof(Rect, rgt) &&
+              offsetof(RpRect, bot) == offsetof(Rect, bot));
+static_assert(sizeof(RpIndexPair) == sizeof(IndexPair) &&
+              offsetof(RpIndexPair, src) == offsetof(IndexPair, src) &&
+              offsetof(RpIndexPair, dst) == offsetof(IndexPair, dst));
+static_assert(sizeof(RpPosition) == sizeof(Point) &&
+              offsetof(RpPosition, x) == offsetof(Point, x) &&
+              offsetof(RpPosition, y) == offsetof(Point, y));
+
+static_assert(RP_HORIZONTAL == HORIZONTAL && RP_VERTICAL == VERTICAL);
+
+struct RpContext {
+  // Backs the arena of every call, grown to the largest job seen so far
+  std::vector<std::byte> buffer = std::vector<std::byte>(1 << 16);
+  CloudStats stats;
+  std::vector<int> orientations; // Of the last placement
+  CloudOptions opts;
+  std::optional<LayoutCache> cache;
+};
 
 namespace {
 thread_local std::string LAST_ERROR;
-}
+} // namespace
 
 const char *rp_get_error() { return LAST_ERROR.c_str(); }
 
-int rp_version() { return 3; }
-
-int rp_pack_rects(RpPosition *out_positions, RpRect *rects, int n_rects,
-                  RpIndexPair *indices, int n_indices, RpPosition center) {
-  std::vector<Rect> in_rects_vec;
-  std::vector<Rect *> out_rects_vec;
-  std::vector<IndexPair> indices_vec;
-  in_rects_vec.reserve(n_rects);
-  out_rects_vec.reserve(n_rects);
-  indices_vec.reserve(n_indices);
-  for (int i = 0; i < n_rects; ++i) {
-    in_rects_vec.emplace_back(rects[i].x, rects[i].y, rects[i].w, rects[i].h);
-  }
-  for (int i = 0; i < n_indices; ++i) {
-    indices_vec.emplace_back(indices[i].src, indices[i].dst);
+int rp_version() { return 12; }
+
+int rp_stats_enabled() {
+#ifdef RP_STATS
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+int rp_trace_write(const char *path) {
+  if (path == nullptr) {
+    LAST_ERROR = "null argument";
+    return -1;
   }
-  Vector2 center_vec{center.x, center.y};
-  auto hierarchies = optimize(in_rects_vec, indices_vec, center_vec);
-  if (!hierarchies.has_value()) {
-    LAST_ERROR = hierarchies.error();
+  if (not trace::write_chrome_json(path)) {
+    LAST_ERROR = std::string{"cannot write "} + path;
     return -1;
   }
-  for (auto &&h : hierarchies.value()) {
-    out_rects_vec.push_back(h.parent);
-    for (auto &&c : h.children) {
-      out_rects_vec.push_back(c);
-    }
+  return 0;
+}
+
+RpContext *rp_context_create() {
+  try {
+    return new RpContext{};
+  } catch (const std::exception &e) {
+    LAST_ERROR = e.what();
+    return nullptr;
   }
+}
 
-  std::ranges::sort(out_rects_vec); // Sorting pointers to preserve input order
-  for (int i = 0; i < ssize(out_rects_vec); ++i) {
-    CUSTOM_ASSERT(out_rects_vec[i]->w == rects[i].w);
-    CUSTOM_ASSERT(out_rects_vec[i]->h == rects[i].h);
-    out_positions[i] = {out_rects_vec[i]->x, out_rects_vec[i]->y};
+void rp_context_destroy(RpContext *ctx) { delete ctx; }
+
+void rp_context_set_int_coordinates(RpContext *ctx, int enabled) {
+  ctx->opts.coordinates =
+      enabled != 0 ? Coordinates::Int32 : Coordinates::Float;
+}
+
+void rp_context_set_frontier(RpContext *ctx, int enabled) {
+  ctx->opts.engine = enabled != 0 ? Engine::Frontier : Engine::Spiral;
+}
+
+void rp_context_set_growth(RpContext *ctx, size_t max_growths, float factor) {
+  ctx->opts.max_growths = max_growths;
+  ctx->opts.growth_factor = factor;
+}
+
+void rp_context_set_compaction(RpContext *ctx, size_t max_rounds,
+                               double max_ms) {
+  ctx->opts.compaction_rounds = max_rounds;
+  ctx->opts.compaction_ms = max_ms;
+}
+
+void rp_context_set_rotation(RpContext *ctx, int enabled) {
+  ctx->opts.rotate = enabled != 0;
+}
+
+void rp_context_set_threads(RpContext *ctx, size_t threads) {
+  ctx->opts.threads = threads;
+}
+
+int rp_context_set_cache(RpContext *ctx, size_t capacity, const char *path) {
+  try {
+    ctx->cache.reset();
+    if (capacity == 0) {
+      return 0;
+    }
+    ctx->cache.emplace(capacity);
+    if (path != nullptr && not ctx->cache->open(path)) {
+      LAST_ERROR = std::string{"could not open "} + path;
+      return -1;
+    }
+    return 0;
+  } catch (const std::exception &e) {
+    LAST_ERROR = e.what();
+    return -1;
   }
+}
+
+void rp_get_cache_stats(const RpContext *ctx, size_t *out_hits,
+                        size_t *out_misses) {
+  *out_hits = ctx->cache ? ctx->cache->hits() : 0;
+  *out_misses = ctx->cache ? ctx->cache->misses() : 0;
+}
 
-  std::cout << "Positions = [";
-  for (int i = 0; i < ssize(out_rects_vec); ++i) {
-    std::cout << "(" << out_positions[i].x << ", " << out_positions[i].y
-              << "), ";
+int rp_place(RpContext *ctx, RpPosition *out_positions, const RpRect *rects,
+             size_t n_rects, const size_t *offsets, size_t n_polygons,
+             const RpIndexPair *indices, size_t n_indices,
+             const float *tolerances, RpPosition board_dims) {
+  if (ctx == nullptr || out_positions == nullptr || rects == nullptr ||
+      offsets == nullptr || indices == nullptr) {
+    LAST_ERROR = "null argument";
+    return -1;
+  }
+  try {
+    // Records how much the arena needed beyond the buffer of the context
+    CountingResource upstream;
+    int placed = 0;
+    {
+      std::pmr::monotonic_buffer_resource arena{
+          ctx->buffer.data(), ctx->buffer.size(), &upstream};
+      std::pmr::vector<float> no_tolerances(&arena);
+      if (tolerances == nullptr) {
+        no_tolerances.resize(n_polygons, 0.F);
+        tolerances = no_tolerances.data();
+      }
+      const PlaceJob job{
+          .rects = {reinterpret_cast<const Rect *>(rects), n_rects},
+          .offsets = {offsets, n_polygons + 1},
+          .indices = {reinterpret_cast<const IndexPair *>(indices),
+                      n_indices},
+          .tolerances = {tolerances, n_polygons},
+          .board_dims = {board_dims.x, board_dims.y},
+      };
+      if (auto error = validate(job, ctx->opts); not error.empty()) {
+        LAST_ERROR = std::move(error);
+        return -1;
+      }
+      const std::span out{reinterpret_cast<Point *>(out_positions),
+                          n_polygons};
+      // Only replaces those of the last placement once this one succeeded
+      std::vector<int> orientations(n_polygons, HORIZONTAL);
+      placed = ctx->cache && not ctx->opts.rotate
+                   ? ctx->cache->place(job, out, ctx->opts, &arena,
+                                       &ctx->stats)
+                   : place(job, out, ctx->opts, &arena, &ctx->stats,
+                           orientations);
+      ctx->orientations.swap(orientations);
+    }
+    if (upstream.allocated > 0) {
+      const auto size = ctx->buffer.size() + upstream.allocated;
+      ctx->buffer = std::vector<std::byte>(size);
+    }
+    return placed;
+  } catch (const std::exception &e) {
+    LAST_ERROR = e.what();
+    return -1;
   }
-  std::cout << "]\n";
+}
 
-  return ssize(out_rects_vec);
+size_t rp_get_orientations(const RpContext *ctx, int *out_orientations,
+                           size_t n_polygons) {
+  const std::size_t n = std::min(n_polygons, ctx->orientations.size());
+  std::copy_n(ctx->orientations.begin(), n, out_orientations);
+  return ctx->orientations.size();
+}
+
+size_t rp_get_stats(const RpContext *ctx, RpStats *out_stats,
+                    RpGroupStats *out_groups, size_t n_groups) {
+  const CloudStats &stats = ctx->stats;
+  *out_stats = RpStats{
+      .rect_intersects = stats.qtree.rect_intersects,
+      .point_intersects = stats.qtree.point_intersects,
+      .nodes_visited = stats.qtree.nodes_visited,
+      .leaf_entries_tested = stats.qtree.leaf_entries_tested,
+      .overflow_spills = stats.qtree.overflow_spills,
+      .closest_isect = stats.closest_isect,
+  };
+  for (std::size_t i = 0; i < stats.groups.size(); ++i) {
+    const auto [probed, erased] = stats.groups[i];
+    out_stats->probed += probed;
+    out_stats->erased += erased;
+    if (out_groups != nullptr && i < n_groups) {
+      out_groups[i] = {probed, erased};
+    }
+  }
+  return stats.groups.size();
 }
-#endif